@@ -0,0 +1,118 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace {
+
+double percentile(const std::vector<double> &sorted, double p) {
+    // Nearest-rank percentile
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const int rank = (int)std::ceil(p / 100.0 * sorted.size());
+    return sorted[std::max(0, std::min(rank - 1, (int)sorted.size() - 1))];
+}
+
+}  // anonymous namespace
+
+BenchmarkReport::BenchmarkReport(const std::vector<std::string> &passNames)
+    : passNames{ passNames }
+    , samples(passNames.size()) {
+}
+
+void BenchmarkReport::addSample(int pass, double milliseconds) {
+    samples[pass].push_back(milliseconds);
+}
+
+void BenchmarkReport::setProperty(const std::string &key, const std::string &value) {
+    properties.emplace_back(key, value);
+}
+
+BenchmarkReport::Statistics BenchmarkReport::statistics(int pass) const {
+    Statistics stats;
+    std::vector<double> sorted = samples[pass];
+    if (sorted.empty()) {
+        return stats;
+    }
+
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (double t : sorted) {
+        sum += t;
+    }
+
+    stats.mean = sum / sorted.size();
+    stats.min = sorted.front();
+    stats.max = sorted.back();
+    stats.p50 = percentile(sorted, 50.0);
+    stats.p95 = percentile(sorted, 95.0);
+    stats.p99 = percentile(sorted, 99.0);
+    return stats;
+}
+
+void BenchmarkReport::print() const {
+    printf("%-10s %10s %10s %10s %10s  [ms]\n", "pass", "mean", "p50", "p95", "p99");
+    for (int i = 0; i < numPasses(); i++) {
+        const Statistics stats = statistics(i);
+        printf("%-10s %10.3f %10.3f %10.3f %10.3f\n", passNames[i].c_str(), stats.mean, stats.p50, stats.p95, stats.p99);
+    }
+}
+
+void BenchmarkReport::save(const std::string &filename) const {
+    const std::string ext = filename.size() >= 4 ? filename.substr(filename.size() - 4) : "";
+    if (ext == ".csv" || ext == ".CSV") {
+        writeCsv(filename);
+    } else {
+        writeJson(filename);
+    }
+    printf("Save: %s\n", filename.c_str());
+}
+
+void BenchmarkReport::writeJson(const std::string &filename) const {
+    std::ofstream writer(filename.c_str(), std::ios::out);
+    if (writer.fail()) {
+        FatalError("Failed to open file: %s", filename.c_str());
+    }
+
+    writer << "{\n";
+    for (const auto &prop : properties) {
+        writer << "  \"" << escapeJson(prop.first) << "\": \"" << escapeJson(prop.second) << "\",\n";
+    }
+
+    writer << "  \"unit\": \"ms\",\n";
+    writer << "  \"passes\": {\n";
+    for (int i = 0; i < numPasses(); i++) {
+        const Statistics stats = statistics(i);
+        writer << "    \"" << escapeJson(passNames[i]) << "\": { "
+               << "\"samples\": " << samples[i].size() << ", "
+               << "\"mean\": " << stats.mean << ", "
+               << "\"min\": " << stats.min << ", "
+               << "\"max\": " << stats.max << ", "
+               << "\"p50\": " << stats.p50 << ", "
+               << "\"p95\": " << stats.p95 << ", "
+               << "\"p99\": " << stats.p99 << " }"
+               << (i + 1 < numPasses() ? ",\n" : "\n");
+    }
+    writer << "  }\n";
+    writer << "}\n";
+}
+
+void BenchmarkReport::writeCsv(const std::string &filename) const {
+    std::ofstream writer(filename.c_str(), std::ios::out);
+    if (writer.fail()) {
+        FatalError("Failed to open file: %s", filename.c_str());
+    }
+
+    // Properties are kept as comment lines so that the table stays machine readable
+    for (const auto &prop : properties) {
+        writer << "# " << prop.first << ": " << prop.second << "\n";
+    }
+
+    writer << "pass,samples,mean_ms,min_ms,max_ms,p50_ms,p95_ms,p99_ms\n";
+    for (int i = 0; i < numPasses(); i++) {
+        const Statistics stats = statistics(i);
+        writer << passNames[i] << "," << samples[i].size() << "," << stats.mean << "," << stats.min << "," << stats.max << ","
+               << stats.p50 << "," << stats.p95 << "," << stats.p99 << "\n";
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "core/common.h"
+
+/**
+ * Collects per-pass GPU times over the measured frames of the benchmark
+ * mode and summarizes them as mean / percentiles (JSON or CSV).
+ */
+class BenchmarkReport {
+public:
+    struct Statistics {
+        double mean = 0.0;
+        double min = 0.0;
+        double max = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+    };
+
+    BenchmarkReport(const std::vector<std::string> &passNames);
+
+    void addSample(int pass, double milliseconds);
+    void setProperty(const std::string &key, const std::string &value);
+
+    Statistics statistics(int pass) const;
+    void print() const;
+    void save(const std::string &filename) const;
+
+    int numPasses() const {
+        return (int)passNames.size();
+    }
+
+    const std::string &passName(int pass) const {
+        return passNames[pass];
+    }
+
+private:
+    void writeJson(const std::string &filename) const;
+    void writeCsv(const std::string &filename) const;
+
+    std::vector<std::string> passNames;
+    std::vector<std::vector<double>> samples;
+    std::vector<std::pair<std::string, std::string>> properties;
+};
@@ -0,0 +1,20 @@
+#include "common.h"
+
+#include <cstdio>
+
+std::string escapeJson(const std::string &str) {
+    std::string ret;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            ret += '\\';
+            ret += c;
+        } else if ((unsigned char)c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+            ret += code;
+        } else {
+            ret += c;
+        }
+    }
+    return ret;
+}
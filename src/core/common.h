@@ -4,6 +4,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
+#include <string>
 #include <cassert>
 
 static const float PI = 4.0f * std::atan(1.0f);
@@ -37,6 +38,13 @@ static const float PI = 4.0f * std::atan(1.0f);
         std::abort();                 \
     } while (false);
 
+// -----------------------------------------------------------------------------
+// JSON output
+// -----------------------------------------------------------------------------
+
+// Escapes a string for a JSON string literal (quotes, backslashes and control characters)
+std::string escapeJson(const std::string &str);
+
 // -----------------------------------------------------------------------------
 // Assertion with message
 // -----------------------------------------------------------------------------
@@ -55,6 +55,10 @@ public:
         printf("******************\n\n");
     }
 
+    bool hasParameter(const std::string& name) const {
+        return data.find(name) != data.end();
+    }
+
     std::string getString(const std::string& name) const {
         const auto it = data.find(name);
         if (it == data.end()) {
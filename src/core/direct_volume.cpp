@@ -1,8 +1,11 @@
 ﻿#include "direct_volume.h"
+#include <algorithm>
+#include <functional>
 #include <vector>
 
 
-#include "volume_texture.h"
+#include "volume_texture_set.h"
+#include "profiler.h"
 
 namespace {
 
@@ -23,6 +26,19 @@ const uint32_t indices[12][3] = {
     { 2, 5, 7 }, { 2, 7, 4 }, { 0, 1, 6 }, { 0, 6, 3 }
 };
 
+bool isOutsideFrustum(const glm::mat4 &viewProjMat, const Cube &cube) {
+    // All the corners are outside of one of the clip planes
+    int outside[6] = { 0, 0, 0, 0, 0, 0 };
+    for (const auto &corner : cube.corners) {
+        const glm::vec4 clip = viewProjMat * glm::vec4(corner, 1.0f);
+        for (int axis = 0; axis < 3; axis++) {
+            outside[axis * 2 + 0] += clip[axis] < -clip.w ? 1 : 0;
+            outside[axis * 2 + 1] += clip[axis] > clip.w ? 1 : 0;
+        }
+    }
+    return std::find(std::begin(outside), std::end(outside), 8) != std::end(outside);
+}
+
 }  // anonymous namespace
 
 void DirectVolume::initialize() {
@@ -33,35 +49,259 @@ void DirectVolume::initialize() {
     program->addShaderFromFile("shaders/direct_volume.frag", ShaderType::Fragment);
     program->link();
 
+    resolveProgram = std::make_shared<ShaderProgram>();
+    resolveProgram->create();
+    resolveProgram->addShaderFromFile("shaders/fullscreen.vert", ShaderType::Vertex);
+    resolveProgram->addShaderFromFile("shaders/volume_resolve.frag", ShaderType::Fragment);
+    resolveProgram->link();
+
+    compositeProgram = std::make_shared<ShaderProgram>();
+    compositeProgram->create();
+    compositeProgram->addShaderFromFile("shaders/fullscreen.vert", ShaderType::Vertex);
+    compositeProgram->addShaderFromFile("shaders/volume_upsample.frag", ShaderType::Fragment);
+    compositeProgram->link();
+
+    // Counters of ray marching steps (total steps, total rays)
+    glGenBuffers(1, &stepCounterBufId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepCounterBufId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 2, nullptr, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
     // Empty VAO
     glGenVertexArrays(1, &vaoId);
     glBindVertexArray(vaoId);
     glBindVertexArray(0);
 }
 
-void DirectVolume::setLocation(const glm::mat4 &transform) {
-    this->modelMat = transform;
-}
+void DirectVolume::draw(const Camera &camera, const PointLight &light, const VolumeTextureSet &volumes) {
+    PROFILE_SCOPE("volume");
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // Ray marching is done at a reduced resolution and upsampled when compositing
+    const int targetWidth = (viewport[2] + resolutionScale - 1) / resolutionScale;
+    const int targetHeight = (viewport[3] + resolutionScale - 1) / resolutionScale;
+    resizeTargets(targetWidth, targetHeight);
+
+    const glm::mat4 viewProjMat = camera.projMat * camera.viewMat;
+    History &history = histories[currentView];
+
+    if (countSteps) {
+        const GLuint zeros[2] = { 0u, 0u };
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepCounterBufId);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeros), zeros);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // Volumes inside the view frustum, from back to front (overlapping volumes are
+    // composited in the order of their centers, not per sample)
+    std::vector<std::pair<float, int>> order;
+    for (int i = 0; i < volumes.size(); i++) {
+        if (!isOutsideFrustum(viewProjMat, volumes[i].marginedCube())) {
+            order.emplace_back(glm::length(volumes[i].marginedCube().center - camera.pos), i);
+        }
+    }
+    std::sort(order.begin(), order.end(), std::greater<std::pair<float, int>>());
+
+    // Ray marching into the offscreen target (the depth test is done when compositing)
+    const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    const GLboolean blend = glIsEnabled(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+
+    // Radiance of nearer volumes is blended over (premultiplied), their entry depth replaces
+    glEnablei(GL_BLEND, 0);
+    glBlendFunci(0, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
-void DirectVolume::draw(const Camera &camera, const PointLight &light, const std::unique_ptr<VolumeTexture> &volTex) {
+    volumeFbo->bind();
     program->bind();
     {
-        program->setUniformValue("u_mMat", modelMat);
-        program->setUniformValue("u_mvpMat", camera.projMat * camera.viewMat * modelMat);
+        glViewport(0, 0, targetWidth, targetHeight);
+        const GLfloat clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const GLfloat clearDepth[4] = { 1.0f, 0.0f, 1.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, clearColor);
+        glClearBufferfv(GL_COLOR, 1, clearDepth);
+
         program->setUniformValue("u_cameraPos", camera.pos);
-        program->setUniformValue("u_sampleNum", volTex->maxExtentMargined());
-        program->setUniformValue("u_albedo", volTex->albedo());
 
-        const auto &corners = volTex->marginedCube().corners;
-        program->setUniformValueArray("u_marginCubeVertices", corners.data(), corners.size());
+        // Steps are not shorter than the footprint of a pixel, and long steps in empty space
+        // are allowed only if the mip texel covers them
+        program->setUniformValue("u_pixelAngle", 2.0f / (camera.projMat[1][1] * (float)targetHeight));
+        program->setUniformValue("u_emptyStepScale", emptyStepScale);
+        program->setUniformValue("u_opacityCutoff", opacityCutoff);
+        program->setUniformValue("u_jitter", temporal ? 1 : 0);
+        program->setUniformValue("u_frameIndex", history.frameIndex);
+        program->setUniformValue("u_countSteps", countSteps ? 1 : 0);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_3D, volTex->getFilteredTexId());
-        program->setUniformValue("u_filteredTex", 0);
+        program->setUniformValue("u_useSceneDepth", sceneDepthTex != nullptr ? 1 : 0);
+        program->setUniformValue("u_invViewProjMat", glm::inverse(viewProjMat));
+        program->setUniformValue("u_viewportSize", glm::vec2(targetWidth, targetHeight));
+        if (sceneDepthTex) {
+            sceneDepthTex->bind(2);
+            program->setUniformValue("u_sceneDepthTex", 2);
+        }
 
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, stepCounterBufId);
         glBindVertexArray(vaoId);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+
+        for (const auto &entry : order) {
+            const VolumeTexture &volTex = volumes[entry.second];
+            const glm::mat4 &modelMat = volumes.transform(entry.second);
+
+            const int sampleNum = std::max(1, (int)(volTex.maxExtentMargined() * sampleRate));
+            const float voxelsPerStep = (float)volTex.maxExtentMargined() / (float)sampleNum;
+
+            program->setUniformValue("u_mMat", modelMat);
+            program->setUniformValue("u_mvpMat", viewProjMat * modelMat);
+            program->setUniformValue("u_sampleNum", sampleNum);
+            program->setUniformValue("u_albedo", volTex.albedo());
+            program->setUniformValue("u_emptySpaceLOD", std::ceil(std::log2(emptyStepScale * voxelsPerStep)) + 1.0f);
+
+            const auto &corners = volTex.marginedCube().corners;
+            program->setUniformValueArray("u_marginCubeVertices", corners.data(), corners.size());
+
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_3D, volTex.getFilteredTexId());
+            program->setUniformValue("u_filteredTex", 0);
+
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_3D, volTex.getSatTexId());
+            program->setUniformValue("u_satTex", 1);
+            program->setUniformValue("u_useSummedAreaTable", volTex.filterMode() == VolumeFilterMode::SummedAreaTable ? 1 : 0);
+            program->setUniformValue("u_satFootprintScale", volTex.satFootprintScale());
+
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+        }
+
         glBindVertexArray(0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
     }
     program->release();
-}
\ No newline at end of file
+    volumeFbo->release();
+    glDisable(GL_BLEND);
+
+    // Temporal accumulation with reprojection
+    std::shared_ptr<Texture> resultTex = volumeFbo->colorTexture(0);
+    if (temporal) {
+        resizeHistory(history, targetWidth, targetHeight);
+        const auto &historyFbo = history.fbos[history.index];
+        const auto &prevHistoryFbo = history.fbos[1 - history.index];
+
+        historyFbo->bind();
+        resolveProgram->bind();
+        {
+            volumeFbo->colorTexture(0)->bind(0);
+            resolveProgram->setUniformValue("u_currentTex", 0);
+            volumeFbo->colorTexture(1)->bind(1);
+            resolveProgram->setUniformValue("u_depthTex", 1);
+            prevHistoryFbo->colorTexture(0)->bind(2);
+            resolveProgram->setUniformValue("u_historyTex", 2);
+
+            resolveProgram->setUniformValue("u_invViewProjMat", glm::inverse(viewProjMat));
+            resolveProgram->setUniformValue("u_prevViewProjMat", history.prevViewProjMat);
+            resolveProgram->setUniformValue("u_cameraPos", camera.pos);
+            resolveProgram->setUniformValue("u_blendFactor", history.valid ? blendFactor : 1.0f);
+
+            glBindVertexArray(vaoId);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+        }
+        resolveProgram->release();
+        historyFbo->release();
+
+        resultTex = historyFbo->colorTexture(0);
+        history.index = 1 - history.index;
+        history.valid = true;
+    }
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    if (depthTest) {
+        glEnable(GL_DEPTH_TEST);
+    }
+    if (blend) {
+        glEnable(GL_BLEND);
+    }
+
+    // The composite pass draws into the target whose depth it reads, so it samples a copy
+    // (reading a bound attachment while it is written is a feedback loop)
+    if (sceneDepthTex) {
+        copySceneDepth();
+    }
+
+    // Upsample and composite over the surfaces with the depth of the ray entry
+    compositeProgram->bind();
+    {
+        resultTex->bind(0);
+        compositeProgram->setUniformValue("u_colorTex", 0);
+        volumeFbo->colorTexture(1)->bind(1);
+        compositeProgram->setUniformValue("u_depthTex", 1);
+
+        compositeProgram->setUniformValue("u_useSceneDepth", sceneDepthTex != nullptr ? 1 : 0);
+        if (sceneDepthTex) {
+            sceneDepthCopy->bind(2);
+            compositeProgram->setUniformValue("u_sceneDepthTex", 2);
+        }
+        compositeProgram->setUniformValue("u_projParams", glm::vec2(camera.projMat[2][2], camera.projMat[3][2]));
+
+        glBindVertexArray(vaoId);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+    }
+    compositeProgram->release();
+
+    if (countSteps) {
+        GLuint counters[2];
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepCounterBufId);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counters), counters);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        stepsPerPixel = counters[1] != 0 ? (double)counters[0] / (double)counters[1] : 0.0;
+    }
+
+    history.prevViewProjMat = viewProjMat;
+    history.frameIndex++;
+}
+
+void DirectVolume::resizeTargets(int width, int height) {
+    if (volumeFbo && volumeFbo->width() == width && volumeFbo->height() == height) {
+        return;
+    }
+
+    if (volumeFbo) {
+        volumeFbo->destroy();
+    }
+    volumeFbo = std::make_shared<Framebuffer>();
+    volumeFbo->create(width, height);
+    volumeFbo->addColorAttachment(GL_RGBA16F, GL_RGBA, GL_FLOAT);  // radiance + opacity
+    volumeFbo->addColorAttachment(GL_RGBA32F, GL_RGBA, GL_FLOAT);  // entry depth, reprojection distance, scene depth
+}
+
+void DirectVolume::copySceneDepth() {
+    const int width = sceneDepthTex->width();
+    const int height = sceneDepthTex->height();
+    if (!sceneDepthCopy || sceneDepthCopy->width() != width || sceneDepthCopy->height() != height) {
+        if (sceneDepthCopy) {
+            sceneDepthCopy->destroy();
+        }
+        sceneDepthCopy = std::make_shared<Texture>(width, height, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT);
+    }
+
+    glCopyImageSubData(sceneDepthTex->getId(), GL_TEXTURE_2D, 0, 0, 0, 0,
+                       sceneDepthCopy->getId(), GL_TEXTURE_2D, 0, 0, 0, 0, width, height, 1);
+}
+
+void DirectVolume::resizeHistory(History &history, int width, int height) {
+    if (history.fbos[0] && history.fbos[0]->width() == width && history.fbos[0]->height() == height) {
+        return;
+    }
+
+    for (auto &fbo : history.fbos) {
+        if (fbo) {
+            fbo->destroy();
+        }
+        fbo = std::make_shared<Framebuffer>();
+        fbo->create(width, height);
+        fbo->addColorAttachment(GL_RGBA16F, GL_RGBA, GL_FLOAT);
+    }
+    history.valid = false;
+}
@@ -1,23 +1,110 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <memory>
+#include <vector>
 
 #include "common.h"
 #include "camera.h"
+#include "framebuffer.h"
 #include "point_light.h"
 #include "shader_program.h"
 
-struct VolumeTexture;
+class VolumeTextureSet;
 
 class DirectVolume {
 public:
 	void initialize();
-	void setLocation(const glm::mat4 &transform);
-	void draw(const Camera &camera, const PointLight &light, const std::unique_ptr<VolumeTexture> &volTex);
+	void draw(const Camera &camera, const PointLight &light, const VolumeTextureSet &volumes);
+
+    // Selects the temporal history of the following draws, so that views drawn in the same
+    // frame are accumulated separately
+    void setView(int index) {
+        if (index >= (int)histories.size()) {
+            histories.resize(index + 1);
+        }
+        this->currentView = index;
+    }
+
+    void setSceneDepthTexture(const std::shared_ptr<Texture> &depthTex) {
+        this->sceneDepthTex = depthTex;
+    }
+
+    void setResolutionScale(int scale) {
+        this->resolutionScale = std::max(1, scale);
+    }
+
+    int getResolutionScale() const {
+        return resolutionScale;
+    }
+
+    void setSampleRate(float rate) {
+        this->sampleRate = rate;
+    }
+
+    void setOpacityCutoff(float cutoff) {
+        this->opacityCutoff = cutoff;
+    }
+
+    void setTemporalAccumulation(bool enable) {
+        this->temporal = enable;
+        for (auto &history : histories) {
+            history.valid = false;
+        }
+    }
+
+    bool isTemporalAccumulationEnabled() const {
+        return temporal;
+    }
+
+    void setStepStatistics(bool enable) {
+        this->countSteps = enable;
+    }
+
+    bool isStepStatisticsEnabled() const {
+        return countSteps;
+    }
+
+    double averageStepsPerPixel() const {
+        return stepsPerPixel;
+    }
 
 private:
+    struct History;
+    void resizeTargets(int width, int height);
+    void resizeHistory(History &history, int width, int height);
+    void copySceneDepth();
+
     GLuint vaoId;
-    glm::mat4 modelMat = glm::mat4(1.0f);
     std::shared_ptr<ShaderProgram> program = nullptr;
+
+    // Ray marching parameters
+    int resolutionScale = 2;       // 1: full, 2: half, 4: quarter resolution
+    float sampleRate = 0.5f;       // # of samples relative to the volume resolution
+    float opacityCutoff = 0.99f;   // rays are terminated beyond this opacity
+    float emptyStepScale = 4.0f;   // step scale in empty space
+    std::shared_ptr<Texture> sceneDepthTex = nullptr;  // rays are terminated at opaque surfaces
+    std::shared_ptr<Texture> sceneDepthCopy = nullptr;  // read by the composite pass, which writes the scene depth
+
+    // Temporal accumulation of jittered ray marching (history of each view)
+    struct History {
+        bool valid = false;
+        int index = 0;
+        int frameIndex = 0;  // jitter sequence
+        glm::mat4 prevViewProjMat = glm::mat4(1.0f);
+        std::array<std::shared_ptr<Framebuffer>, 2> fbos;
+    };
+    bool temporal = true;
+    float blendFactor = 0.1f;
+    int currentView = 0;
+    std::vector<History> histories = std::vector<History>(1);
+    std::shared_ptr<Framebuffer> volumeFbo = nullptr;
+    std::shared_ptr<ShaderProgram> resolveProgram = nullptr;
+    std::shared_ptr<ShaderProgram> compositeProgram = nullptr;
+
+    // Statistics of ray marching steps
+    bool countSteps = false;
+    double stepsPerPixel = 0.0;
+    GLuint stepCounterBufId = 0;
 };
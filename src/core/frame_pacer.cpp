@@ -0,0 +1,56 @@
+#include "frame_pacer.h"
+
+#include <chrono>
+
+FramePacer::FramePacer() {
+}
+
+FramePacer::~FramePacer() {
+}
+
+void FramePacer::destroy() {
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (fences[i] != 0) {
+            glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+    }
+}
+
+void FramePacer::beginFrame() {
+    // Wait for the frames older than "framesInFlight" (slots are reused every MAX_FRAMES_IN_FLIGHT frames)
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (int i = MAX_FRAMES_IN_FLIGHT; i >= framesInFlight_; i--) {
+        GLsync &fence = fences[(frameIndex_ + MAX_FRAMES_IN_FLIGHT - i) % MAX_FRAMES_IN_FLIGHT];
+        if (fence == 0) {
+            continue;
+        }
+
+        // Flush only on the first try, so that the fence is surely submitted
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (true) {
+            const GLenum status = glClientWaitSync(fence, flags, 1000000);  // 1 [ms]
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                break;
+            }
+            if (status == GL_WAIT_FAILED) {
+                FatalError("FramePacer: glClientWaitSync failed!");
+            }
+            flags = 0;
+        }
+
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    waitTime_ = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void FramePacer::endFrame() {
+    GLsync &fence = fences[frameSlot()];
+    if (fence != 0) {
+        glDeleteSync(fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frameIndex_++;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+
+#include "core/common.h"
+
+/**
+ * Limits the number of frames queued on the GPU with fence objects. The CPU
+ * prepares frame N+1 while the GPU still works on frame N, but waits once
+ * "framesInFlight" frames are pending. Fewer frames in flight means lower
+ * latency, more frames means better overlap of CPU and GPU work.
+ * Per-frame dynamic resources should be multi-buffered by MAX_FRAMES_IN_FLIGHT.
+ */
+class FramePacer {
+public:
+    static constexpr int MAX_FRAMES_IN_FLIGHT = 3;
+
+    FramePacer();
+    virtual ~FramePacer();
+
+    void beginFrame();
+    void endFrame();
+    void destroy();
+
+    int framesInFlight() const {
+        return framesInFlight_;
+    }
+
+    void setFramesInFlight(int n) {
+        this->framesInFlight_ = std::max(1, std::min(n, MAX_FRAMES_IN_FLIGHT));
+    }
+
+    int frameIndex() const {
+        return frameIndex_;
+    }
+
+    int frameSlot() const {
+        return frameIndex_ % MAX_FRAMES_IN_FLIGHT;
+    }
+
+    double waitTime() const {
+        // CPU time blocked by the last beginFrame (in milliseconds)
+        return waitTime_;
+    }
+
+private:
+    GLsync fences[MAX_FRAMES_IN_FLIGHT] = { 0, 0, 0 };
+    int framesInFlight_ = 2;
+    int frameIndex_ = 0;
+    double waitTime_ = 0.0;
+};
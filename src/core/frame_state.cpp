@@ -0,0 +1,34 @@
+#include "frame_state.h"
+
+namespace {
+
+bool isSameCamera(const Camera &a, const Camera &b) {
+    return a.pos == b.pos && a.dir == b.dir && a.up == b.up && a.viewMat == b.viewMat && a.projMat == b.projMat;
+}
+
+}  // anonymous namespace
+
+bool FrameState::needsRender(const std::vector<Camera> &cameras, const PointLight &light, uint64_t volumeRevision, uint64_t sceneRevision) {
+    bool changed = !valid || volumeRevision != this->volumeRevision || sceneRevision != this->sceneRevision ||
+                   light.pos != this->light.pos || light.Le != this->light.Le || cameras.size() != this->cameras.size();
+    for (size_t i = 0; !changed && i < cameras.size(); i++) {
+        changed = !isSameCamera(cameras[i], this->cameras[i]);
+    }
+
+    if (changed) {
+        this->valid = true;
+        this->cameras = cameras;
+        this->light = light;
+        this->volumeRevision = volumeRevision;
+        this->sceneRevision = sceneRevision;
+        remainingFrames = settleFrames;
+    } else if (remainingFrames > 0) {
+        remainingFrames--;
+    } else {
+        skippedFrames++;
+        return false;
+    }
+
+    renderedFrames++;
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "camera.h"
+#include "point_light.h"
+
+/**
+ * Inputs of a rendered frame: the cameras of the views, the light, and the revisions of
+ * the volumes and the surface scene. Render settings are not compared, so a change of
+ * them has to "invalidate" the state. A frame whose inputs equal those of the last
+ * rendered frame reproduces its image, so the render loop presents the previous image
+ * instead. A few frames are still rendered after each change, while the temporal
+ * accumulation and the occlusion culling (which lag one frame) settle.
+ */
+class FrameState {
+public:
+    // Returns whether the frame has to be rendered, and records its inputs
+    bool needsRender(const std::vector<Camera> &cameras, const PointLight &light, uint64_t volumeRevision, uint64_t sceneRevision);
+
+    void invalidate() {
+        this->valid = false;
+    }
+
+    void setSettleFrames(int frames) {
+        this->settleFrames = frames;
+    }
+
+    int numRenderedFrames() const {
+        return renderedFrames;
+    }
+
+    int numSkippedFrames() const {
+        return skippedFrames;
+    }
+
+private:
+    bool valid = false;
+    int settleFrames = 0;
+    int remainingFrames = 0;
+    int renderedFrames = 0;
+    int skippedFrames = 0;
+
+    std::vector<Camera> cameras;
+    PointLight light;
+    uint64_t volumeRevision = 0;
+    uint64_t sceneRevision = 0;
+};
@@ -0,0 +1,73 @@
+#include "framebuffer.h"
+
+Framebuffer::Framebuffer() {
+}
+
+Framebuffer::~Framebuffer() {
+}
+
+void Framebuffer::create(int width, int height) {
+    width_ = width;
+    height_ = height;
+    glGenFramebuffers(1, &fboId);
+}
+
+void Framebuffer::addColorAttachment(GLenum internalFormat, GLenum format, GLenum type) {
+    auto tex = std::make_shared<Texture>(width_, height_, internalFormat, format, type);
+    const GLenum attachment = GL_COLOR_ATTACHMENT0 + (GLenum)colorTextures.size();
+    colorTextures.push_back(tex);
+
+    std::vector<GLenum> drawBuffers;
+    for (size_t i = 0; i < colorTextures.size(); i++) {
+        drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + (GLenum)i);
+    }
+
+    bind();
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, tex->getId(), 0);
+    glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+    checkStatus();
+    release();
+}
+
+void Framebuffer::addDepthAttachment() {
+    depthTex = std::make_shared<Texture>(width_, height_, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT);
+
+    bind();
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTex->getId(), 0);
+    checkStatus();
+    release();
+}
+
+void Framebuffer::bind() {
+    // Remember the current target so that nested render passes can go back to it
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFboId);
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+}
+
+void Framebuffer::release() {
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)prevFboId);
+}
+
+void Framebuffer::destroy() {
+    for (auto &tex : colorTextures) {
+        tex->destroy();
+    }
+    colorTextures.clear();
+
+    if (depthTex) {
+        depthTex->destroy();
+        depthTex = nullptr;
+    }
+
+    if (fboId != 0) {
+        glDeleteFramebuffers(1, &fboId);
+        fboId = 0;
+    }
+}
+
+void Framebuffer::checkStatus() {
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        FatalError("Framebuffer is incomplete: status = 0x%x", status);
+    }
+}
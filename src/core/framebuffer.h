@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "core/common.h"
+#include "texture.h"
+
+class Framebuffer {
+public:
+    Framebuffer();
+    virtual ~Framebuffer();
+
+    void create(int width, int height);
+    void addColorAttachment(GLenum internalFormat = GL_RGBA8, GLenum format = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE);
+    void addDepthAttachment();
+    void bind();
+    void release();
+    void destroy();
+
+    GLuint getId() const { return fboId; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    const std::shared_ptr<Texture> &colorTexture(int i = 0) const { return colorTextures[i]; }
+    const std::shared_ptr<Texture> &depthTexture() const { return depthTex; }
+
+private:
+    void checkStatus();
+
+    GLuint fboId = 0u;
+    GLint prevFboId = 0;
+    int width_ = 0, height_ = 0;
+    std::vector<std::shared_ptr<Texture>> colorTextures;
+    std::shared_ptr<Texture> depthTex = nullptr;
+};
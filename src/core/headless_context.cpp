@@ -0,0 +1,129 @@
+#include "headless_context.h"
+
+#ifdef USE_HEADLESS_EGL
+
+#include <cstring>
+
+#include <EGL/eglext.h>
+
+namespace {
+
+bool hasExtension(const char *extensions, const char *name) {
+    if (extensions == nullptr) {
+        return false;
+    }
+
+    const size_t len = strlen(name);
+    for (const char *p = strstr(extensions, name); p != nullptr; p = strstr(p + len, name)) {
+        if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // anonymous namespace
+
+HeadlessContext::HeadlessContext() {
+}
+
+HeadlessContext::~HeadlessContext() {
+    destroy();
+}
+
+void HeadlessContext::create() {
+    // Display (surfaceless platform if available)
+    const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    bool surfaceless = false;
+    if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        auto eglGetPlatformDisplayEXT = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (eglGetPlatformDisplayEXT) {
+            display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            surfaceless = display != EGL_NO_DISPLAY;
+        }
+    }
+
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || eglInitialize(display, &major, &minor) != EGL_TRUE) {
+        FatalError("EGL: failed to initialize display!");
+    }
+
+    // Config
+    const bool noSurface = surfaceless || hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, noSurface ? 0 : EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if (eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) != EGL_TRUE || numConfigs == 0) {
+        FatalError("EGL: no suitable config found!");
+    }
+
+    // Context
+    if (eglBindAPI(EGL_OPENGL_API) != EGL_TRUE) {
+        FatalError("EGL: desktop OpenGL is not supported!");
+    }
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        FatalError("EGL: failed to create OpenGL 4.5 core context!");
+    }
+
+    // Dummy surface (only when the context cannot be made current without it)
+    if (!noSurface) {
+        const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+        if (surface == EGL_NO_SURFACE) {
+            FatalError("EGL: failed to create pbuffer surface!");
+        }
+    }
+
+    printf("EGL %d.%d (%s)\n", major, minor, surfaceless ? "surfaceless" : noSurface ? "no surface" : "pbuffer");
+}
+
+void HeadlessContext::makeCurrent() {
+    if (eglMakeCurrent(display, surface, surface, context) != EGL_TRUE) {
+        FatalError("EGL: failed to make the context current!");
+    }
+}
+
+void HeadlessContext::destroy() {
+    if (display == EGL_NO_DISPLAY) {
+        return;
+    }
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (surface != EGL_NO_SURFACE) {
+        eglDestroySurface(display, surface);
+        surface = EGL_NO_SURFACE;
+    }
+    if (context != EGL_NO_CONTEXT) {
+        eglDestroyContext(display, context);
+        context = EGL_NO_CONTEXT;
+    }
+    eglTerminate(display);
+    display = EGL_NO_DISPLAY;
+}
+
+void *HeadlessContext::getProcAddress(const char *name) {
+    return (void *)eglGetProcAddress(name);
+}
+
+#endif  // USE_HEADLESS_EGL
@@ -0,0 +1,31 @@
+#pragma once
+
+#ifdef USE_HEADLESS_EGL
+
+#include <EGL/egl.h>
+
+#include "core/common.h"
+
+/**
+ * OpenGL 4.5 core context without any window nor display server (EGL).
+ * The surfaceless platform of Mesa is tried first, then a small pbuffer
+ * on the default display. Rendering must go to user framebuffers.
+ */
+class HeadlessContext {
+public:
+    HeadlessContext();
+    virtual ~HeadlessContext();
+
+    void create();
+    void makeCurrent();
+    void destroy();
+
+    static void *getProcAddress(const char *name);
+
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+};
+
+#endif  // USE_HEADLESS_EGL
@@ -1,85 +1,788 @@
 ﻿#include "indirect_surface.h"
 
+#include <algorithm>
+#include <cmath>
 #include <ctime>
 #include <iostream>
 #include <deque>
 
 #include "common.h"
 #include "ltc_texture.h"
-#include "volume_texture.h"
+#include "volume_texture_set.h"
+#include "profiler.h"
+
+namespace {
+
+// std140 layouts of "lpal_common.glsl" (vec3 is padded to vec4)
+struct LpalVolumeBlock {
+    glm::vec4 albedo;
+    glm::vec4 cubeCenter;
+    glm::vec4 probeBoundsMin;
+    glm::vec4 probeBoundsMax;
+    glm::vec4 marginCubeVertices[8];
+    glm::vec4 originalCubeVertices[8];
+    float boundingRadius;
+    float voxelSize;
+    int maxLOD;
+    int padding;
+};
+
+struct LpalShadingBlock {
+    glm::vec4 cameraPos;
+    glm::vec4 lightPos;
+    glm::vec3 lightLe;
+    float pixelAngle;
+    int sectionNum;
+    int skipBlockSize;
+    int useIrradianceProbes;
+    int numVolumes;
+    LpalVolumeBlock volumes[VolumeTextureSet::MAX_VOLUMES];
+};
+
+static_assert(sizeof(LpalVolumeBlock) == 336, "LpalVolumeBlock does not match the std140 layout!");
+static_assert(sizeof(LpalShadingBlock) == 64 + 336 * VolumeTextureSet::MAX_VOLUMES, "LpalShadingBlock does not match the std140 layout!");
+
+const int LPAL_SHADING_BINDING = 0;
+
+// std430 layouts of "surface_instances.glsl"
+struct MeshBlock {
+    glm::vec4 positionOffset;
+    glm::vec4 positionScale;
+    GLuint firstIndex;
+    GLuint indexCount;
+    GLuint baseVertex;
+    GLuint vertexCount;
+};
+
+struct InstanceBlock {
+    glm::mat4 modelMat;
+    GLuint mesh;
+    GLuint vertexIndirectOffset;
+    GLuint material;
+    GLuint padding;
+};
+
+// std430 layout of "surface_materials.glsl"
+struct MaterialBlock {
+    glm::vec4 eta;
+    glm::vec4 kappa;
+    glm::vec4 diffColor;
+    float roughness;
+    int isRoughnessTextured;
+    float vertexRateThreshold;
+    float padding;
+};
+
+struct DrawElementsCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLuint baseVertex;
+    GLuint baseInstance;
+};
+
+static_assert(sizeof(MeshBlock) == 48, "MeshBlock does not match the std430 layout!");
+static_assert(sizeof(InstanceBlock) == 80, "InstanceBlock does not match the std430 layout!");
+static_assert(sizeof(MaterialBlock) == 64, "MaterialBlock does not match the std430 layout!");
+static_assert(sizeof(DrawElementsCommand) == 20, "DrawElementsCommand does not match glMultiDrawElementsIndirect!");
+
+// Shader storage bindings (the vertex-rate indirect illumination is bound at 1)
+const int MESH_BINDING = 2;
+const int INSTANCE_BINDING = 3;
+const int DRAW_COMMAND_BINDING = 4;
+const int CULL_STATISTICS_BINDING = 5;
+const int MATERIAL_BINDING = 6;
+
+// Vertex attribute with the instance index ("in_instance" in indirect_LPAL.vert)
+const int INSTANCE_ATTRIB_LOCATION = 3;
+
+// Texture units: 0-2 (LTC tables, roughness), 8-9 (G-buffer), then the volumes
+// (filtered, summed-area table and three probe textures for each)
+const int VOLUME_TEXTURE_UNIT = 10;
+const int TEXTURE_UNITS_PER_VOLUME = 5;
+
+}  // anonymous namespace
 
 void IndirectSurface::initialize() {
     ltcMatTexId = createLTCmatTex();
     ltcMagTexId = createLTCmagTex();
 
+    // Volumes whose samplers fit in the texture units of the LPAL programs (fragment and compute)
+    GLint fragmentUnits, computeUnits, combinedUnits;
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &fragmentUnits);
+    glGetIntegerv(GL_MAX_COMPUTE_TEXTURE_IMAGE_UNITS, &computeUnits);
+    glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &combinedUnits);
+    const int otherSamplers = 6;  // LTC tables, roughness and the G-buffer of the tile shading
+    maxVolumes_ = std::min((std::min(fragmentUnits, computeUnits) - otherSamplers) / TEXTURE_UNITS_PER_VOLUME,
+                           (combinedUnits - VOLUME_TEXTURE_UNIT) / TEXTURE_UNITS_PER_VOLUME);
+    maxVolumes_ = std::max(1, std::min(maxVolumes_, VolumeTextureSet::MAX_VOLUMES));
+    const std::string volumeDefine = "MAX_VOLUMES " + std::to_string(maxVolumes_);
+
+    // Rows of work groups of the per-instance dispatch (at least 65535)
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 1, &maxWorkGroupRows);
+
     // Shader program
     program = std::make_shared<ShaderProgram>();
     program->create();
     program->addShaderFromFile("shaders/indirect_LPAL.vert", ShaderType::Vertex);
-    program->addShaderFromFile("shaders/indirect_LPAL.frag", ShaderType::Fragment);
+    program->addShaderFromFile("shaders/indirect_LPAL.frag", ShaderType::Fragment, { volumeDefine });
     program->link();
 
+    // Vertex shader only (no color output)
+    depthProgram = std::make_shared<ShaderProgram>();
+    depthProgram->create();
+    depthProgram->addShaderFromFile("shaders/indirect_LPAL.vert", ShaderType::Vertex);
+    depthProgram->link();
+
+    cullProgram = std::make_shared<ShaderProgram>();
+    cullProgram->create();
+    cullProgram->addShaderFromFile("shaders/cullInstances.comp", ShaderType::Compute);
+    cullProgram->link();
+
+    hizProgram = std::make_shared<ShaderProgram>();
+    hizProgram->create();
+    hizProgram->addShaderFromFile("shaders/buildHiZ.comp", ShaderType::Compute);
+    hizProgram->link();
+
+    vertexIndirectProgram = std::make_shared<ShaderProgram>();
+    vertexIndirectProgram->create();
+    vertexIndirectProgram->addShaderFromFile("shaders/vertexIndirect.comp", ShaderType::Compute, { volumeDefine });
+    vertexIndirectProgram->link();
+
+    gbufferProgram = std::make_shared<ShaderProgram>();
+    gbufferProgram->create();
+    gbufferProgram->addShaderFromFile("shaders/indirect_LPAL.vert", ShaderType::Vertex);
+    gbufferProgram->addShaderFromFile("shaders/indirect_gbuffer.frag", ShaderType::Fragment);
+    gbufferProgram->link();
+
+    classifyProgram = std::make_shared<ShaderProgram>();
+    classifyProgram->create();
+    classifyProgram->addShaderFromFile("shaders/classifyTiles.comp", ShaderType::Compute, { volumeDefine });
+    classifyProgram->link();
+
+    // One LPAL variant for each tile class: no volume, rough (coarse LOD, fewer slices) and glossy
+    const std::vector<std::string> tileDefines[numTileClasses] = {
+        { "TILE_CLASS 0", volumeDefine },
+        { "TILE_CLASS 1", "LPAL_LOD_BIAS 1.0", volumeDefine },
+        { "TILE_CLASS 2", volumeDefine },
+    };
+    for (int i = 0; i < numTileClasses; i++) {
+        tileShadingPrograms[i] = std::make_shared<ShaderProgram>();
+        tileShadingPrograms[i]->create();
+        tileShadingPrograms[i]->addShaderFromFile("shaders/indirect_LPAL.comp", ShaderType::Compute, tileDefines[i]);
+        tileShadingPrograms[i]->link();
+    }
+
+    compositeProgram = std::make_shared<ShaderProgram>();
+    compositeProgram->create();
+    compositeProgram->addShaderFromFile("shaders/fullscreen.vert", ShaderType::Vertex);
+    compositeProgram->addShaderFromFile("shaders/composite.frag", ShaderType::Fragment);
+    compositeProgram->link();
+
+    glGenBuffers(1, &dispatchArgsBufId);
+    glGenBuffers(1, &tileListBufId);
+    glGenVertexArrays(1, &emptyVaoId);
+    glGenQueries(2, fragmentQueryIds);
+
+    glGenBuffers(1, &vertexIndirectBufId);
+    glGenBuffers(1, &meshBufId);
+    glGenBuffers(1, &instanceBufId);
+    glGenBuffers(1, &instanceIdBufId);
+    glGenBuffers(1, &drawCommandBufId);
+    glGenBuffers(1, &cullStatsBufId);
+    glGenBuffers(1, &materialBufId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullStatsBufId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    shadingBuffer = std::make_shared<UniformBuffer>(sizeof(LpalShadingBlock), MAX_VIEWS);
+
     // Vertex array object
     vao = std::make_shared<VertexArrayObject>();
     vao->create();
 }
 
 void IndirectSurface::setMeshFromFile(const std::string& filename) {
-    vao->addMeshFromFile(filename);
+    PROFILE_SCOPE("loadMesh");
+    setScene(SurfaceScene::fromMesh(MeshData::load(filename)));
+}
+
+void IndirectSurface::setMesh(const MeshData &mesh) {
+    setScene(SurfaceScene::fromMesh(mesh));
+}
+
+void IndirectSurface::setScene(const SurfaceScene &scene) {
+    sceneRevision_++;
+    vao->setMeshes(scene.meshes.data(), scene.meshes.size());
+    materials.assign(1, SurfaceMaterial());
+    materials.insert(materials.end(), scene.materials.begin(), scene.materials.end());
+    materialsDirty = true;
+    const auto &ranges = vao->meshRanges();
+
+    // Mesh table: ranges in the shared buffers and dequantization of the vertex positions
+    std::vector<MeshBlock> meshBlocks(ranges.size());
+    maxMeshVertices = 0;
+    for (size_t i = 0; i < ranges.size(); i++) {
+        meshBlocks[i].positionOffset = glm::vec4(ranges[i].positionOffset, 0.0f);
+        meshBlocks[i].positionScale = glm::vec4(ranges[i].positionScale, 0.0f);
+        meshBlocks[i].firstIndex = ranges[i].firstIndex;
+        meshBlocks[i].indexCount = ranges[i].indexCount;
+        meshBlocks[i].baseVertex = ranges[i].baseVertex;
+        meshBlocks[i].vertexCount = ranges[i].vertexCount;
+        maxMeshVertices = std::max(maxMeshVertices, ranges[i].vertexCount);
+    }
+
+    // Instance table, where each instance has its own part of the vertex-rate buffer
+    instanceCount = scene.instances.size();
+    std::vector<InstanceBlock> instanceBlocks(instanceCount);
+    std::vector<GLuint> instanceIds(instanceCount);
+    GLuint numInstanceVertices = 0;
+    for (int i = 0; i < instanceCount; i++) {
+        const auto &instance = scene.instances[i];
+        instanceBlocks[i].modelMat = instance.transform;
+        instanceBlocks[i].mesh = instance.mesh;
+        instanceBlocks[i].material = instance.material;
+        instanceBlocks[i].vertexIndirectOffset = numInstanceVertices;
+        numInstanceVertices += ranges[instance.mesh].vertexCount;
+        instanceIds[i] = i;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshBufId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(MeshBlock) * meshBlocks.size(), meshBlocks.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBufId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(InstanceBlock) * instanceBlocks.size(), instanceBlocks.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawCommandBufId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(DrawElementsCommand) * instanceCount, nullptr, GL_DYNAMIC_COPY);
+
+    // Per-vertex buffer for vertex-rate indirect illumination
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, vertexIndirectBufId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec4) * numInstanceVertices, nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceIdBufId);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * instanceIds.size(), instanceIds.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    vao->setInstanceIdBuffer(INSTANCE_ATTRIB_LOCATION, instanceIdBufId);
 }
 
 void IndirectSurface::setRoughnessTexure(const std::string &filename) {
     roughnessTex = std::make_shared<Texture>(filename, true);
+    sceneRevision_++;
 }
 
-void IndirectSurface::draw(const Camera &camera, const PointLight &light, const std::unique_ptr<VolumeTexture> &volTex) {
+void IndirectSurface::setRoughnessTexure(const ImageData &image) {
+    roughnessTex = std::make_shared<Texture>(image, true);
+    sceneRevision_++;
+}
+
+void IndirectSurface::draw(const Camera &camera, const PointLight &light, const VolumeTextureSet &volumes) {
+    PROFILE_SCOPE("surface");
+    updateShadingBuffer(camera, light, volumes);
+    if (materialsDirty) {
+        updateMaterialBuffer();
+    }
+
+    // Mesh / instance tables and the draw commands, which are read by all the passes below
+    const glm::mat4 viewProjMat = camera.projMat * camera.viewMat;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESH_BINDING, meshBufId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, instanceBufId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_COMMAND_BINDING, drawCommandBufId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BINDING, materialBufId);
+    cullInstances(viewProjMat);
+
+    if (tileClassification) {
+        drawTileClassified(camera, volumes);
+        buildHiZ(gbuffer->depthTexture(), viewProjMat);
+    } else {
+        drawForward(camera, volumes);
+        buildHiZ(sceneDepthTex, viewProjMat);
+    }
+
+    if (countFragments) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullStatsBufId);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &visibleInstances);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESH_BINDING, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_COMMAND_BINDING, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BINDING, 0);
+}
+
+void IndirectSurface::drawForward(const Camera &camera, const VolumeTextureSet &volumes) {
+    if (vertexRate) {
+        evaluateVertexIndirect(volumes);
+    }
+
+    const glm::mat4 viewProjMat = camera.projMat * camera.viewMat;
+
+    if (depthPrepass) {
+        PROFILE_SCOPE("depthPrepass");
+        drawDepthOnly(viewProjMat);
+
+        // Only the nearest fragment of each pixel passes (early fragment tests are forced in the shader)
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
+
+    if (countFragments) {
+        glBeginQuery(GL_SAMPLES_PASSED, fragmentQueryIds[0]);
+    }
+
     program->bind();
     {
-        glm::mat4 mMat, mvMat, mvpMat, normMat;
-        mMat = glm::mat4(1.0f);
-        mvMat = camera.viewMat * mMat;
-        mvpMat = camera.projMat * mvMat;
-        normMat = glm::transpose(glm::inverse(mvMat));
-
-        program->setUniformValue("u_lightMat", camera.viewMat);
-        program->setUniformValue("u_mMat", mMat);
-        program->setUniformValue("u_mvMat", mvMat);
-        program->setUniformValue("u_mvpMat", mvpMat);
-        program->setUniformValue("u_normMat", normMat);
-
-        program->setUniformValue("u_cameraPos", camera.pos);
-        program->setUniformValue("u_lightPos", light.pos);
-        program->setUniformValue("u_lightLe", light.Le);
-        program->setUniformValue("u_sectionNum", nSections);
-        program->setUniformValue("u_alpha", roughness);
-        program->setUniformValue("u_isAlphaTextured", roughnessTex != nullptr ? 1 : 1);
-        program->setUniformValue("u_albedo", volTex->albedo());
-        program->setUniformValue("u_maxLOD", volTex->maxLod());
-
-        const auto &marginCube = volTex->marginedCube();
-        program->setUniformValueArray("u_marginCubeVertices", marginCube.corners.data(), marginCube.corners.size());
-        program->setUniformValue("u_cubeCenter", marginCube.center);
-
-        const auto &innerCube = volTex->innerCube();
-        program->setUniformValueArray("u_originalCubeVertices", innerCube.corners.data(), innerCube.corners.size());
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, ltcMatTexId);
-        program->setUniformValue("u_ltcMatTex", 0);
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, ltcMagTexId);
-        program->setUniformValue("u_ltcMagTex", 1);
-
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, roughnessTex->getId());
-        program->setUniformValue("u_alphaTex", 2);
-
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_3D, volTex->getFilteredTexId());
-        program->setUniformValue("u_filteredTex", 3);
-
-        vao->draw(GL_TRIANGLES);
+        // Handles are resolved on the first draw, which waits for the link anyway (resolving them
+        // at initialization would block before the other programs are submitted)
+        if (!surfaceUniforms.resolved) {
+            surfaceUniforms.viewProjMat = program->uniform<glm::mat4>("u_viewProjMat");
+            surfaceUniforms.useVertexRate = program->uniform<int>("u_useVertexRate");
+            surfaceUniforms.resolved = true;
+        }
+
+        surfaceUniforms.viewProjMat.set(viewProjMat);
+
+        setShadingUniforms(program, volumes);
+
+        surfaceUniforms.useVertexRate.set(vertexRate ? 1 : 0);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, vertexIndirectBufId);
+        drawInstances();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
     }
     program->release();
-}
\ No newline at end of file
+
+    if (countFragments) {
+        glEndQuery(GL_SAMPLES_PASSED);
+
+        // Visible pixels: fragments at the final depth of the surfaces
+        glBeginQuery(GL_SAMPLES_PASSED, fragmentQueryIds[1]);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+        drawDepthOnly(viewProjMat);
+        glEndQuery(GL_SAMPLES_PASSED);
+
+        // Read back immediately (statistics only, this stalls the pipeline)
+        glGetQueryObjectuiv(fragmentQueryIds[0], GL_QUERY_RESULT, &shadedFragments);
+        glGetQueryObjectuiv(fragmentQueryIds[1], GL_QUERY_RESULT, &visiblePixels);
+    }
+
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+}
+
+void IndirectSurface::cullInstances(const glm::mat4 &viewProjMat) {
+    PROFILE_SCOPE("cullInstances");
+    static const int localSize = 64;
+
+    const GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullStatsBufId);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_STATISTICS_BINDING, cullStatsBufId);
+
+    cullProgram->bind();
+    {
+        cullProgram->setUniformValue("u_instanceCount", instanceCount);
+        cullProgram->setUniformValue("u_viewProjMat", viewProjMat);
+        cullProgram->setUniformValue("u_frustumCulling", frustumCulling ? 1 : 0);
+
+        // Nothing is culled by occlusion until the depth of a frame is available
+        const HiZ &hiz = hizViews[currentView];
+        const bool useHiZ = occlusionCulling && hiz.valid;
+        cullProgram->setUniformValue("u_occlusionCulling", useHiZ ? 1 : 0);
+        if (useHiZ) {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, hiz.texId);
+            cullProgram->setUniformValue("u_hizTex", 0);
+            cullProgram->setUniformValue("u_hizViewProjMat", hiz.viewProjMat);
+            cullProgram->setUniformValue("u_hizLevels", hiz.levels);
+        }
+
+        glDispatchCompute((instanceCount + localSize - 1) / localSize, 1, 1);
+    }
+    cullProgram->release();
+
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_STATISTICS_BINDING, 0);
+}
+
+void IndirectSurface::buildHiZ(const std::shared_ptr<Texture> &depthTex, const glm::mat4 &viewProjMat) {
+    static const int localSize = 8;
+
+    HiZ &hiz = hizViews[currentView];
+    if (!occlusionCulling || !depthTex) {
+        hiz.valid = false;
+        return;
+    }
+
+    PROFILE_SCOPE("buildHiZ");
+    if (hiz.texId == 0 || hiz.width != depthTex->width() || hiz.height != depthTex->height()) {
+        if (hiz.texId != 0) {
+            glDeleteTextures(1, &hiz.texId);
+        }
+
+        hiz.width = depthTex->width();
+        hiz.height = depthTex->height();
+        hiz.levels = 1 + (int)std::floor(std::log2((float)std::max(hiz.width, hiz.height)));
+
+        glGenTextures(1, &hiz.texId);
+        glBindTexture(GL_TEXTURE_2D, hiz.texId);
+        glTexStorage2D(GL_TEXTURE_2D, hiz.levels, GL_R32F, hiz.width, hiz.height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Level 0 is the depth buffer, and each next level keeps the farthest of 2x2 texels
+    hizProgram->bind();
+    {
+        depthTex->bind(0);
+        hizProgram->setUniformValue("u_depthTex", 0);
+
+        for (int level = 0; level < hiz.levels; level++) {
+            const int width = std::max(hiz.width >> level, 1);
+            const int height = std::max(hiz.height >> level, 1);
+            hizProgram->setUniformValue("u_copyDepth", level == 0 ? 1 : 0);
+            glBindImageTexture(0, hiz.texId, std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glBindImageTexture(1, hiz.texId, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glDispatchCompute((width + localSize - 1) / localSize, (height + localSize - 1) / localSize, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+        glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    }
+    hizProgram->release();
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    hiz.viewProjMat = viewProjMat;
+    hiz.valid = true;
+}
+
+void IndirectSurface::drawInstances() {
+    // One command per instance, where culled instances have no instance to draw
+    vao->drawIndirect(GL_TRIANGLES, drawCommandBufId, instanceCount);
+}
+
+void IndirectSurface::drawDepthOnly(const glm::mat4 &viewProjMat) {
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    depthProgram->bind();
+    {
+        depthProgram->setUniformValue("u_viewProjMat", viewProjMat);
+        drawInstances();
+    }
+    depthProgram->release();
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void IndirectSurface::evaluateVertexIndirect(const VolumeTextureSet &volumes) {
+    static const int localSize = 64;
+
+    vertexIndirectProgram->bind();
+    {
+        // Mip level of roughness texture which roughly matches the vertex spacing
+        const float texelsPerVertex = (float)(roughnessTex->width() * roughnessTex->height()) / (float)std::max(maxMeshVertices, 1u);
+        vertexIndirectProgram->setUniformValue("u_alphaLOD", std::max(0.0f, 0.5f * std::log2(texelsPerVertex)));
+
+        setShadingUniforms(vertexIndirectProgram, volumes);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, vao->vertexBufferId());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, vertexIndirectBufId);
+
+        // One row of work groups per instance (culled instances return immediately). The rows
+        // are folded into Z, since the work group count in Y may be as low as 65535
+        const int numGroupSize = (maxMeshVertices + localSize - 1) / localSize;
+        const int numRows = std::min(instanceCount, maxWorkGroupRows);
+        const int numSlabs = (instanceCount + numRows - 1) / numRows;
+        vertexIndirectProgram->setUniformValue("u_instanceCount", instanceCount);
+        glDispatchCompute(numGroupSize, numRows, numSlabs);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+    }
+    vertexIndirectProgram->release();
+}
+
+void IndirectSurface::drawTileClassified(const Camera &camera, const VolumeTextureSet &volumes) {
+    static const int tileSize = 8;
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    const int width = viewport[2];
+    const int height = viewport[3];
+    resizeTileTargets(width, height);
+
+    const glm::ivec2 screenSize(width, height);
+    const int tilesX = (width + tileSize - 1) / tileSize;
+    const int tilesY = (height + tileSize - 1) / tileSize;
+
+    if (vertexRate) {
+        evaluateVertexIndirect(volumes);
+    }
+
+    // G-buffer (world position + roughness, normal + material, vertex-rate indirect illumination)
+    gbuffer->bind();
+    {
+        glViewport(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+        const GLboolean blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_BLEND);
+
+        gbufferProgram->bind();
+        {
+            gbufferProgram->setUniformValue("u_viewProjMat", camera.projMat * camera.viewMat);
+
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, roughnessTex->getId());
+            gbufferProgram->setUniformValue("u_alphaTex", 0);
+            gbufferProgram->setUniformValue("u_useVertexRate", vertexRate ? 1 : 0);
+
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, vertexIndirectBufId);
+            drawInstances();
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+        }
+        gbufferProgram->release();
+
+        if (blend) {
+            glEnable(GL_BLEND);
+        }
+    }
+    gbuffer->release();
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    // Reset tile counters (num_groups_x, num_groups_y, num_groups_z) for each class
+    GLuint dispatchArgs[numTileClasses * 3];
+    for (int i = 0; i < numTileClasses; i++) {
+        dispatchArgs[i * 3 + 0] = 0u;
+        dispatchArgs[i * 3 + 1] = 1u;
+        dispatchArgs[i * 3 + 2] = 1u;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, dispatchArgsBufId);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(dispatchArgs), dispatchArgs);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, dispatchArgsBufId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, tileListBufId);
+
+    // Tile classification
+    classifyProgram->bind();
+    {
+        classifyProgram->setUniformValue("u_screenSize", screenSize);
+        classifyProgram->setUniformValue("u_maxTiles", maxTiles);
+        classifyProgram->setUniformValue("u_roughThreshold", tileRoughThreshold);
+
+        gbuffer->colorTexture(0)->bind(0);
+        classifyProgram->setUniformValue("u_positionTex", 0);
+        gbuffer->colorTexture(1)->bind(1);
+        classifyProgram->setUniformValue("u_normalTex", 1);
+        gbuffer->colorTexture(2)->bind(2);
+        classifyProgram->setUniformValue("u_indirectTex", 2);
+
+        glDispatchCompute(tilesX, tilesY, 1);
+    }
+    classifyProgram->release();
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+    // Shade only the listed tiles with the LPAL variant of each class
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, dispatchArgsBufId);
+    glBindImageTexture(0, tileColorTex->getId(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    for (int i = 0; i < numTileClasses; i++) {
+        const auto &prog = tileShadingPrograms[i];
+        prog->bind();
+        {
+            setShadingUniforms(prog, volumes);
+            prog->setUniformValue("u_screenSize", screenSize);
+            prog->setUniformValue("u_maxTiles", maxTiles);
+
+            gbuffer->colorTexture(0)->bind(8);
+            prog->setUniformValue("u_positionTex", 8);
+            gbuffer->colorTexture(1)->bind(9);
+            prog->setUniformValue("u_normalTex", 9);
+            gbuffer->colorTexture(2)->bind(7);
+            prog->setUniformValue("u_indirectTex", 7);
+
+            glDispatchComputeIndirect((GLintptr)(sizeof(GLuint) * 3 * i));
+        }
+        prog->release();
+    }
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    // Composite into the current render target with the depth of the G-buffer
+    compositeProgram->bind();
+    {
+        tileColorTex->bind(0);
+        compositeProgram->setUniformValue("u_colorTex", 0);
+        gbuffer->depthTexture()->bind(1);
+        compositeProgram->setUniformValue("u_depthTex", 1);
+
+        glBindVertexArray(emptyVaoId);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+    }
+    compositeProgram->release();
+}
+
+void IndirectSurface::resizeTileTargets(int width, int height) {
+    static const int tileSize = 8;
+
+    if (gbuffer && gbuffer->width() == width && gbuffer->height() == height) {
+        return;
+    }
+
+    if (gbuffer) {
+        gbuffer->destroy();
+    }
+    if (tileColorTex) {
+        tileColorTex->destroy();
+    }
+
+    gbuffer = std::make_shared<Framebuffer>();
+    gbuffer->create(width, height);
+    gbuffer->addColorAttachment(GL_RGBA32F, GL_RGBA, GL_FLOAT);  // position + roughness
+    gbuffer->addColorAttachment(GL_RGBA16F, GL_RGBA, GL_FLOAT);  // normal + material index (0: not covered)
+    gbuffer->addColorAttachment(GL_RGBA16F, GL_RGBA, GL_FLOAT);  // vertex-rate indirect illumination (W: used)
+    gbuffer->addDepthAttachment();
+
+    tileColorTex = std::make_shared<Texture>(width, height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+
+    // Every tile may end up in any class
+    maxTiles = ((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, dispatchArgsBufId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 3 * numTileClasses, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileListBufId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * maxTiles * numTileClasses, nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void IndirectSurface::updateShadingBuffer(const Camera &camera, const PointLight &light, const VolumeTextureSet &volumes) {
+    // Only the first volumes which fit in the texture units light the surfaces
+    const int numVolumes = std::min(volumes.size(), maxVolumes_);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    LpalShadingBlock block = {};
+    block.cameraPos = glm::vec4(camera.pos, 1.0f);
+    block.lightPos = glm::vec4(light.pos, 1.0f);
+    block.lightLe = light.Le;
+    block.pixelAngle = 2.0f / (camera.projMat[1][1] * (float)std::max(viewport[3], 1));
+    block.sectionNum = nSections;
+    block.skipBlockSize = skipBlockSize;
+    block.useIrradianceProbes = useIrradianceProbes ? 1 : 0;
+    block.numVolumes = numVolumes;
+
+    for (int v = 0; v < numVolumes; v++) {
+        const VolumeTexture &volTex = volumes[v];
+        LpalVolumeBlock &volume = block.volumes[v];
+        volume.albedo = glm::vec4(volTex.albedo(), 0.0f);
+
+        const auto &marginCube = volTex.marginedCube();
+        const auto &innerCube = volTex.innerCube();
+        volume.cubeCenter = glm::vec4(marginCube.center, 1.0f);
+        volume.boundingRadius = 0.0f;
+        for (int i = 0; i < 8; i++) {
+            volume.marginCubeVertices[i] = glm::vec4(marginCube.corners[i], 1.0f);
+            volume.originalCubeVertices[i] = glm::vec4(innerCube.corners[i], 1.0f);
+            volume.boundingRadius = std::max(volume.boundingRadius, glm::length(marginCube.corners[i] - marginCube.center));
+        }
+
+        // Corners 1, 2 and 3 are next to corner 0 along X, Y and Z
+        const glm::vec3 texSize = volTex.marginedTexSize();
+        volume.voxelSize = 0.0f;
+        for (int axis = 0; axis < 3; axis++) {
+            const float edgeLength = glm::length(marginCube.corners[axis + 1] - marginCube.corners[0]);
+            volume.voxelSize = std::max(volume.voxelSize, edgeLength / texSize[axis]);
+        }
+
+        volume.probeBoundsMin = glm::vec4(volTex.probeBoundsMin(), 1.0f);
+        volume.probeBoundsMax = glm::vec4(volTex.probeBoundsMax(), 1.0f);
+        volume.maxLOD = volTex.maxLod();
+    }
+
+    shadingBuffer->setData(&block);
+    shadingBuffer->bind(LPAL_SHADING_BINDING);
+}
+
+void IndirectSurface::updateMaterialBuffer() {
+    std::vector<MaterialBlock> blocks(materials.size());
+    for (size_t i = 0; i < materials.size(); i++) {
+        blocks[i].eta = glm::vec4(materials[i].eta, 0.0f);
+        blocks[i].kappa = glm::vec4(materials[i].kappa, 0.0f);
+        blocks[i].diffColor = glm::vec4(materials[i].diffColor, 0.0f);
+        blocks[i].roughness = materials[i].roughness;
+        blocks[i].isRoughnessTextured = materials[i].roughnessTextured ? 1 : 0;
+        blocks[i].vertexRateThreshold = materials[i].vertexRateThreshold;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBufId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(MaterialBlock) * blocks.size(), blocks.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    materialsDirty = false;
+}
+
+void IndirectSurface::setShadingUniforms(const std::shared_ptr<ShaderProgram> &prog, const VolumeTextureSet &volumes) {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, ltcMatTexId);
+    prog->setUniformValue("u_ltcMatTex", 0);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, ltcMagTexId);
+    prog->setUniformValue("u_ltcMagTex", 1);
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, roughnessTex->getId());
+    prog->setUniformValue("u_alphaTex", 2);
+
+    // Every element of the sampler arrays has its own unit (also the unused ones, which
+    // must not share a unit with a sampler of another type)
+    std::vector<int> filteredUnits(maxVolumes_), satUnits(maxVolumes_);
+    std::vector<int> probeUnits[3] = { std::vector<int>(maxVolumes_), std::vector<int>(maxVolumes_), std::vector<int>(maxVolumes_) };
+    for (int v = 0; v < maxVolumes_; v++) {
+        const int unit = VOLUME_TEXTURE_UNIT + TEXTURE_UNITS_PER_VOLUME * v;
+        filteredUnits[v] = unit;
+        satUnits[v] = unit + 1;
+        for (int axis = 0; axis < 3; axis++) {
+            probeUnits[axis][v] = unit + 2 + axis;
+        }
+
+        if (v >= volumes.size()) {
+            continue;
+        }
+
+        const VolumeTexture &volTex = volumes[v];
+        glActiveTexture(GL_TEXTURE0 + filteredUnits[v]);
+        glBindTexture(GL_TEXTURE_3D, volTex.getFilteredTexId());
+        glActiveTexture(GL_TEXTURE0 + satUnits[v]);
+        glBindTexture(GL_TEXTURE_3D, volTex.getSatTexId());
+
+        // Irradiance probes for diffuse indirect illumination
+        for (int axis = 0; axis < 3; axis++) {
+            glActiveTexture(GL_TEXTURE0 + probeUnits[axis][v]);
+            glBindTexture(GL_TEXTURE_3D, volTex.getProbeTexId(axis));
+        }
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    prog->setUniformValueArray("u_filteredTex", filteredUnits.data(), maxVolumes_);
+    prog->setUniformValueArray("u_satTex", satUnits.data(), maxVolumes_);
+    prog->setUniformValueArray("u_probeTexX", probeUnits[0].data(), maxVolumes_);
+    prog->setUniformValueArray("u_probeTexY", probeUnits[1].data(), maxVolumes_);
+    prog->setUniformValueArray("u_probeTexZ", probeUnits[2].data(), maxVolumes_);
+
+    // The filter mode is shared by all the volumes of the set
+    prog->setUniformValue("u_useSummedAreaTable", volumes.filterMode() == VolumeFilterMode::SummedAreaTable ? 1 : 0);
+    prog->setUniformValue("u_satFootprintScale", volumes.empty() ? 1.0f : volumes[0].satFootprintScale());
+}
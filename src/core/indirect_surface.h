@@ -1,39 +1,239 @@
 #pragma once
 
+#include <array>
 #include <memory>
+#include <vector>
 
 #include "camera.h"
+#include "framebuffer.h"
 #include "point_light.h"
 #include "vertex_array_object.h"
 #include "shader_program.h"
+#include "surface_scene.h"
 #include "texture.h"
+#include "uniform_buffer.h"
 
-struct VolumeTexture;
+class VolumeTextureSet;
 
 class IndirectSurface { // : public RenderObject {
 public:
+    // Views drawn in one frame, each updating the shading parameters once
+    static constexpr int MAX_VIEWS = 4;
+
     void initialize();
     void setMeshFromFile(const std::string &filename);
+    void setMesh(const MeshData &mesh);
+    void setScene(const SurfaceScene &scene);
     void setRoughnessTexure(const std::string &filename);
-    void draw(const Camera &camera, const PointLight &light, const std::unique_ptr<VolumeTexture> &volTex);
+    void setRoughnessTexure(const ImageData &image);
+    void draw(const Camera &camera, const PointLight &light, const VolumeTextureSet &volumes);
+
+    // Depth of the render target, from which the occlusion culling of the next frame is built
+    void setSceneDepthTexture(const std::shared_ptr<Texture> &depthTex) {
+        this->sceneDepthTex = depthTex;
+    }
 
-    void setRoughnessValue(float roughness) {
-        this->roughness = roughness;
+    // Selects the hierarchical depth used for the occlusion culling of the following draws,
+    // so that views drawn in the same frame are culled against their own previous frame
+    void setView(int index) {
+        if (index >= (int)hizViews.size()) {
+            hizViews.resize(index + 1);
+        }
+        this->currentView = index;
     }
 
     void setNumSections(int sections) {
         this->nSections = sections;
     }
 
+    void setSkipBlockSize(int slices) {
+        this->skipBlockSize = slices;
+    }
+
+    // Volumes shaded together, limited by the texture units (5 samplers per volume)
+    int maxVolumes() const {
+        return maxVolumes_;
+    }
+
+    // Incremented whenever the meshes, the instances, the materials or the roughness texture change
+    uint64_t sceneRevision() const {
+        return sceneRevision_;
+    }
+
+    void setUseIrradianceProbes(bool enable) {
+        this->useIrradianceProbes = enable;
+    }
+
+    void setVertexRateEnabled(bool enable) {
+        this->vertexRate = enable;
+    }
+
+    bool isVertexRateEnabled() const {
+        return vertexRate;
+    }
+
+    void setTileClassification(bool enable) {
+        this->tileClassification = enable;
+    }
+
+    bool isTileClassificationEnabled() const {
+        return tileClassification;
+    }
+
+    void setTileRoughThreshold(float alpha) {
+        this->tileRoughThreshold = alpha;
+    }
+
+    void setDepthPrepass(bool enable) {
+        this->depthPrepass = enable;
+    }
+
+    bool isDepthPrepassEnabled() const {
+        return depthPrepass;
+    }
+
+    void setShadingStatistics(bool enable) {
+        this->countFragments = enable;
+    }
+
+    bool isShadingStatisticsEnabled() const {
+        return countFragments;
+    }
+
+    void setFrustumCulling(bool enable) {
+        this->frustumCulling = enable;
+    }
+
+    bool isFrustumCullingEnabled() const {
+        return frustumCulling;
+    }
+
+    void setOcclusionCulling(bool enable) {
+        this->occlusionCulling = enable;
+    }
+
+    bool isOcclusionCullingEnabled() const {
+        return occlusionCulling;
+    }
+
+    int numInstances() const {
+        return instanceCount;
+    }
+
+    // Instances which passed the culling in the last draw (counted with the shading statistics)
+    GLuint numVisibleInstances() const {
+        return visibleInstances;
+    }
+
+    // LPAL fragments shaded in the last draw, and pixels covered by the surfaces
+    GLuint numShadedFragments() const {
+        return shadedFragments;
+    }
+
+    GLuint numVisiblePixels() const {
+        return visiblePixels;
+    }
+
+    double overdraw() const {
+        return visiblePixels != 0 ? (double)shadedFragments / (double)visiblePixels : 0.0;
+    }
 
 private:
+    void drawForward(const Camera &camera, const VolumeTextureSet &volumes);
+    void cullInstances(const glm::mat4 &viewProjMat);
+    void buildHiZ(const std::shared_ptr<Texture> &depthTex, const glm::mat4 &viewProjMat);
+    void drawInstances();
+    void drawDepthOnly(const glm::mat4 &viewProjMat);
+    void evaluateVertexIndirect(const VolumeTextureSet &volumes);
+    void drawTileClassified(const Camera &camera, const VolumeTextureSet &volumes);
+    void resizeTileTargets(int width, int height);
+    void updateMaterialBuffer();
+    void updateShadingBuffer(const Camera &camera, const PointLight &light, const VolumeTextureSet &volumes);
+    void setShadingUniforms(const std::shared_ptr<ShaderProgram> &prog, const VolumeTextureSet &volumes);
+
     GLuint ltcMatTexId;
     GLuint ltcMagTexId;
 
-    float roughness = 0.001f;
     int nSections = 128;
+    int skipBlockSize = 8;
+    bool useIrradianceProbes = true;
+    int maxVolumes_ = 0;
+
+    // Material table (entry 0: default material, followed by the materials of the scene)
+    std::vector<SurfaceMaterial> materials = { SurfaceMaterial() };
+    bool materialsDirty = true;
+    uint64_t sceneRevision_ = 0;
+    GLuint materialBufId = 0;
+
+    // Vertex-rate evaluation of indirect illumination for rough surfaces
+    bool vertexRate = false;
+    GLuint vertexIndirectBufId = 0;
+    GLint maxWorkGroupRows = 65535;
+
+    // Instances of the meshes, culled on the GPU and drawn with one multi-draw per pass
+    int instanceCount = 0;
+    GLuint maxMeshVertices = 0;
+    GLuint meshBufId = 0;
+    GLuint instanceBufId = 0;
+    GLuint instanceIdBufId = 0;
+    GLuint drawCommandBufId = 0;
+    GLuint cullStatsBufId = 0;
+    GLuint visibleInstances = 0;
+    bool frustumCulling = true;
+    std::shared_ptr<ShaderProgram> cullProgram = nullptr;
+
+    // Occlusion culling against the hierarchical depth (max-reduced mip chain) of the previous frame of each view
+    struct HiZ {
+        bool valid = false;
+        int width = 0;
+        int height = 0;
+        int levels = 0;
+        GLuint texId = 0;
+        glm::mat4 viewProjMat = glm::mat4(1.0f);
+    };
+    bool occlusionCulling = true;
+    int currentView = 0;
+    std::vector<HiZ> hizViews = std::vector<HiZ>(1);
+    std::shared_ptr<Texture> sceneDepthTex = nullptr;
+    std::shared_ptr<ShaderProgram> hizProgram = nullptr;
+
+    // Screen-space tile classification (G-buffer + per-class indirect dispatch)
+    static const int numTileClasses = 3;
+    bool tileClassification = false;
+    float tileRoughThreshold = 0.3f;
+    int maxTiles = 0;
+    GLuint dispatchArgsBufId = 0;
+    GLuint tileListBufId = 0;
+    GLuint emptyVaoId = 0;
+    std::shared_ptr<Framebuffer> gbuffer = nullptr;
+    std::shared_ptr<Texture> tileColorTex = nullptr;
+
+    // Depth-only pre-pass, so that the LPAL shading runs once per pixel (depth test: GL_EQUAL)
+    bool depthPrepass = false;
+    std::shared_ptr<ShaderProgram> depthProgram = nullptr;
+
+    // Statistics of the LPAL shading (occlusion queries: shaded fragments, visible pixels)
+    bool countFragments = false;
+    GLuint shadedFragments = 0;
+    GLuint visiblePixels = 0;
+    GLuint fragmentQueryIds[2] = { 0, 0 };
 
     std::shared_ptr<VertexArrayObject> vao = nullptr;
     std::shared_ptr<ShaderProgram> program = nullptr;
+    std::shared_ptr<ShaderProgram> vertexIndirectProgram = nullptr;
+    std::shared_ptr<ShaderProgram> gbufferProgram = nullptr;
+    std::shared_ptr<ShaderProgram> classifyProgram = nullptr;
+    std::array<std::shared_ptr<ShaderProgram>, numTileClasses> tileShadingPrograms;
+    std::shared_ptr<ShaderProgram> compositeProgram = nullptr;
     std::shared_ptr<Texture> roughnessTex = nullptr;
+
+    // Per-draw LPAL parameters (uniform block "LpalShading" in "lpal_common.glsl")
+    std::shared_ptr<UniformBuffer> shadingBuffer = nullptr;
+
+    // Handles of the uniforms set for every draw (resolved on the first draw)
+    struct {
+        bool resolved = false;
+        Uniform<glm::mat4> viewProjMat;
+        Uniform<int> useVertexRate;
+    } surfaceUniforms;
 };
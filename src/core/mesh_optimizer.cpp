@@ -0,0 +1,326 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+// Forsyth's scoring parameters (cache of 32 vertices modelled as LRU)
+const int SCORE_CACHE_SIZE = 32;
+const int MAX_VALENCE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+// FIFO cache used to simulate the hardware in the overdraw optimization
+const int SIMULATED_CACHE_SIZE = 16;
+
+struct VertexScoreTable {
+    VertexScoreTable() {
+        for (int i = 0; i < SCORE_CACHE_SIZE; i++) {
+            if (i < 3) {
+                // Vertices of the last triangle get a fixed score, so that strips are not favoured
+                cache[i] = LAST_TRIANGLE_SCORE;
+            } else {
+                const float scale = 1.0f / (SCORE_CACHE_SIZE - 3);
+                cache[i] = std::pow(1.0f - (i - 3) * scale, CACHE_DECAY_POWER);
+            }
+        }
+
+        // Vertices with few remaining triangles are boosted, so that no lone triangles are left behind
+        valence[0] = 0.0f;
+        for (int i = 1; i <= MAX_VALENCE; i++) {
+            valence[i] = VALENCE_BOOST_SCALE * std::pow((float)i, -VALENCE_BOOST_POWER);
+        }
+    }
+
+    float score(int cachePosition, int numTriangles) const {
+        if (numTriangles == 0) {
+            return -1.0f;
+        }
+        const float cacheScore = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+        return cacheScore + valence[std::min(numTriangles, MAX_VALENCE)];
+    }
+
+    float cache[SCORE_CACHE_SIZE];
+    float valence[MAX_VALENCE + 1];
+};
+
+// Returns the number of cache misses of the triangle
+int updateFifoCache(const uint32_t *triangle, std::vector<uint32_t> &timestamps, uint32_t &timestamp, int cacheSize) {
+    int misses = 0;
+    for (int k = 0; k < 3; k++) {
+        const uint32_t v = triangle[k];
+        if (timestamp - timestamps[v] > (uint32_t)cacheSize) {
+            timestamps[v] = timestamp++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+// First triangle of each cluster with the simulated cache (the last entry is the number of triangles)
+std::vector<size_t> findClusters(const std::vector<uint32_t> &indices, size_t numVertices, float threshold) {
+    const size_t numTriangles = indices.size() / 3;
+    std::vector<uint32_t> timestamps(numVertices, 0);
+    uint32_t timestamp = SIMULATED_CACHE_SIZE + 1;
+
+    // Hard boundaries: three misses usually mean that a disjoint patch of the mesh starts
+    std::vector<size_t> hardBoundaries;
+    for (size_t t = 0; t < numTriangles; t++) {
+        const int misses = updateFifoCache(&indices[t * 3], timestamps, timestamp, SIMULATED_CACHE_SIZE);
+        if (t == 0 || misses == 3) {
+            hardBoundaries.push_back(t);
+        }
+    }
+    hardBoundaries.push_back(numTriangles);
+
+    // Soft boundaries: a patch is split where the running ACMR reaches the ACMR of the patch
+    std::vector<size_t> clusters;
+    for (size_t c = 0; c + 1 < hardBoundaries.size(); c++) {
+        const size_t start = hardBoundaries[c];
+        const size_t end = hardBoundaries[c + 1];
+
+        timestamp += SIMULATED_CACHE_SIZE + 1;
+        int patchMisses = 0;
+        for (size_t t = start; t < end; t++) {
+            patchMisses += updateFifoCache(&indices[t * 3], timestamps, timestamp, SIMULATED_CACHE_SIZE);
+        }
+        const float targetACMR = threshold * (float)patchMisses / (float)(end - start);
+
+        clusters.push_back(start);
+        timestamp += SIMULATED_CACHE_SIZE + 1;
+        int misses = 0;
+        int triangles = 0;
+        for (size_t t = start; t < end; t++) {
+            misses += updateFifoCache(&indices[t * 3], timestamps, timestamp, SIMULATED_CACHE_SIZE);
+            triangles++;
+            if ((float)misses / (float)triangles <= targetACMR && t + 1 < end) {
+                clusters.push_back(t + 1);
+                timestamp += SIMULATED_CACHE_SIZE + 1;
+                misses = 0;
+                triangles = 0;
+            }
+        }
+
+        // The remainder did not reach the target, and is rather merged into the previous cluster
+        if (triangles > 0 && clusters.size() > 1 && clusters.back() != start) {
+            clusters.pop_back();
+        }
+    }
+    clusters.push_back(numTriangles);
+    return clusters;
+}
+
+}  // anonymous namespace
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t numVertices) {
+    static const VertexScoreTable scoreTable;
+
+    const size_t numTriangles = indices.size() / 3;
+    if (numTriangles == 0) {
+        return;
+    }
+
+    // Triangles adjacent to each vertex (the first "liveTriangles[v]" ones are not emitted yet)
+    std::vector<uint32_t> liveTriangles(numVertices, 0);
+    for (uint32_t index : indices) {
+        liveTriangles[index]++;
+    }
+
+    std::vector<uint32_t> adjacencyOffsets(numVertices + 1, 0);
+    std::partial_sum(liveTriangles.begin(), liveTriangles.end(), adjacencyOffsets.begin() + 1);
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t t = 0; t < numTriangles; t++) {
+            for (int k = 0; k < 3; k++) {
+                adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+            }
+        }
+    }
+
+    std::vector<float> vertexScores(numVertices);
+    for (size_t v = 0; v < numVertices; v++) {
+        vertexScores[v] = scoreTable.score(-1, liveTriangles[v]);
+    }
+
+    std::vector<float> triangleScores(numTriangles);
+    for (size_t t = 0; t < numTriangles; t++) {
+        triangleScores[t] = vertexScores[indices[t * 3 + 0]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+    }
+
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<int> cachePositions(numVertices, -1);
+    std::vector<uint32_t> cache, nextCache;
+    cache.reserve(SCORE_CACHE_SIZE + 3);
+    nextCache.reserve(SCORE_CACHE_SIZE + 3);
+
+    std::vector<uint32_t> output(indices.size());
+    size_t inputCursor = 0;
+    int64_t bestTriangle = -1;
+    for (size_t i = 0; i < numTriangles; i++) {
+        if (bestTriangle < 0) {
+            // Dead end (no triangle touches the cache): continue with the next triangle of the input order
+            while (emitted[inputCursor]) {
+                inputCursor++;
+            }
+            bestTriangle = (int64_t)inputCursor;
+        }
+
+        const uint32_t *triangle = &indices[bestTriangle * 3];
+        std::copy(triangle, triangle + 3, &output[i * 3]);
+        emitted[bestTriangle] = true;
+
+        for (int k = 0; k < 3; k++) {
+            const uint32_t v = triangle[k];
+            uint32_t *begin = &adjacency[adjacencyOffsets[v]];
+            uint32_t *end = begin + liveTriangles[v];
+            uint32_t *it = std::find(begin, end, (uint32_t)bestTriangle);
+            if (it != end) {
+                std::swap(*it, *(end - 1));
+                liveTriangles[v]--;
+            }
+        }
+
+        // The vertices of the triangle move to the front of the LRU cache
+        nextCache.clear();
+        for (int k = 0; k < 3; k++) {
+            if (std::find(nextCache.begin(), nextCache.end(), triangle[k]) == nextCache.end()) {
+                nextCache.push_back(triangle[k]);
+            }
+        }
+        for (uint32_t v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                nextCache.push_back(v);
+            }
+        }
+
+        // Rescore the vertices which moved in (or dropped out of) the cache
+        for (size_t c = 0; c < nextCache.size(); c++) {
+            const uint32_t v = nextCache[c];
+            cachePositions[v] = c < SCORE_CACHE_SIZE ? (int)c : -1;
+
+            const float score = scoreTable.score(cachePositions[v], liveTriangles[v]);
+            const float delta = score - vertexScores[v];
+            vertexScores[v] = score;
+
+            const uint32_t *adjacent = &adjacency[adjacencyOffsets[v]];
+            for (uint32_t j = 0; j < liveTriangles[v]; j++) {
+                triangleScores[adjacent[j]] += delta;
+            }
+        }
+
+        if (nextCache.size() > SCORE_CACHE_SIZE) {
+            nextCache.resize(SCORE_CACHE_SIZE);
+        }
+        std::swap(cache, nextCache);
+
+        // Next triangle is the best one touching the cache
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (uint32_t v : cache) {
+            const uint32_t *adjacent = &adjacency[adjacencyOffsets[v]];
+            for (uint32_t j = 0; j < liveTriangles[v]; j++) {
+                if (triangleScores[adjacent[j]] > bestScore) {
+                    bestScore = triangleScores[adjacent[j]];
+                    bestTriangle = adjacent[j];
+                }
+            }
+        }
+    }
+
+    indices.swap(output);
+}
+
+void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<Vertex> &vertices, float threshold) {
+    const size_t numTriangles = indices.size() / 3;
+    if (numTriangles == 0) {
+        return;
+    }
+
+    const std::vector<size_t> clusters = findClusters(indices, vertices.size(), threshold);
+    const size_t numClusters = clusters.size() - 1;
+
+    // Area weighted centroid and normal of each cluster (the cross product is twice the area)
+    std::vector<glm::vec3> clusterCentroids(numClusters, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormals(numClusters, glm::vec3(0.0f));
+    std::vector<float> clusterAreas(numClusters, 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < numClusters; c++) {
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            const glm::vec3 &p0 = vertices[indices[t * 3 + 0]].position;
+            const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].position;
+            const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const float area = glm::length(normal);
+
+            clusterCentroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            clusterNormals[c] += normal;
+            clusterAreas[c] += area;
+        }
+
+        meshCentroid += clusterCentroids[c];
+        meshArea += clusterAreas[c];
+    }
+    meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : glm::vec3(0.0f);
+
+    // Clusters facing outwards are likely in front of the others, whichever side the camera is
+    std::vector<float> occlusionPotential(numClusters, 0.0f);
+    for (size_t c = 0; c < numClusters; c++) {
+        const float normalLength = glm::length(clusterNormals[c]);
+        if (clusterAreas[c] > 0.0f && normalLength > 0.0f) {
+            const glm::vec3 centroid = clusterCentroids[c] / clusterAreas[c];
+            occlusionPotential[c] = glm::dot(centroid - meshCentroid, clusterNormals[c] / normalLength);
+        }
+    }
+
+    std::vector<size_t> order(numClusters);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return occlusionPotential[a] > occlusionPotential[b];
+    });
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (size_t c : order) {
+        output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    }
+    indices.swap(output);
+}
+
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices) {
+    static const uint32_t unused = ~0u;
+
+    std::vector<uint32_t> remap(vertices.size(), unused);
+    std::vector<Vertex> output;
+    output.reserve(vertices.size());
+    for (uint32_t &index : indices) {
+        if (remap[index] == unused) {
+            remap[index] = (uint32_t)output.size();
+            output.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    // Vertices not referenced by any triangle are dropped
+    vertices.swap(output);
+}
+
+float averageCacheMissRatio(const std::vector<uint32_t> &indices, size_t numVertices, int cacheSize) {
+    const size_t numTriangles = indices.size() / 3;
+    if (numTriangles == 0) {
+        return 0.0f;
+    }
+
+    std::vector<uint32_t> timestamps(numVertices, 0);
+    uint32_t timestamp = cacheSize + 1;
+    size_t misses = 0;
+    for (size_t t = 0; t < numTriangles; t++) {
+        misses += updateFifoCache(&indices[t * 3], timestamps, timestamp, cacheSize);
+    }
+    return (float)misses / (float)numTriangles;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+#include "core/vertex_array_object.h"
+
+/**
+ * Load-time optimization of indexed triangle meshes. The passes are meant to be
+ * applied in this order: vertex cache, overdraw (which keeps the cache locality
+ * within clusters of triangles) and finally vertex fetch.
+ */
+
+// Triangle order for the post-transform vertex cache (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t numVertices);
+
+/**
+ * Splits the triangles into clusters where the cache locality allows it, and sorts the
+ * clusters so that the ones facing away from the mesh center are drawn first (Sander et al.,
+ * "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"). This approximates
+ * the front-to-back order for any view direction, so that the depth test rejects more
+ * fragments before the expensive shading. "threshold" is the allowed ACMR increase.
+ */
+void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<Vertex> &vertices, float threshold = 1.05f);
+
+// Renumbers the vertices in the order of their first use
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices);
+
+// Average number of vertex shader invocations per triangle with a FIFO cache of "cacheSize" vertices
+float averageCacheMissRatio(const std::vector<uint32_t> &indices, size_t numVertices, int cacheSize = 16);
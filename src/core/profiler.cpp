@@ -0,0 +1,251 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "trace.h"
+
+namespace {
+
+bool hasDebugGroups() {
+    return GLAD_GL_VERSION_4_3 || GLAD_GL_KHR_debug;
+}
+
+glm::vec3 scopeColor(const std::string &name) {
+    // Stable color for each scope name
+    const size_t h = std::hash<std::string>()(name);
+    return glm::vec3(0.35f + 0.6f * ((h >> 0) & 0xff) / 255.0f,
+                     0.35f + 0.6f * ((h >> 8) & 0xff) / 255.0f,
+                     0.35f + 0.6f * ((h >> 16) & 0xff) / 255.0f);
+}
+
+// Scopes of the threads without GL context
+thread_local std::vector<std::pair<const char *, double>> workerStack;
+
+// GPU and CPU clocks are calibrated again at this interval to follow their drift
+const int CALIBRATION_INTERVAL = 64;
+
+}  // anonymous namespace
+
+Profiler &Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler()
+    : epoch{ std::chrono::high_resolution_clock::now() }
+    , glThread{ std::this_thread::get_id() } {
+    frames[0].index = 0;
+}
+
+double Profiler::now() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - epoch).count();
+}
+
+void Profiler::calibrate() {
+    // GL_TIMESTAMP is the GPU time when all previous commands reached the GPU (no wait for their completion)
+    glGetInteger64v(GL_TIMESTAMP, &gpuCalibration);
+    cpuCalibration = now();
+
+    Frame &frame = frames[frameIndex % FRAMES_IN_FLIGHT];
+    frame.gpuCalibration = gpuCalibration;
+    frame.cpuCalibration = cpuCalibration;
+}
+
+void Profiler::beginFrame() {
+    if (enabled && (gpuCalibration < 0 || frameIndex % CALIBRATION_INTERVAL == 0)) {
+        calibrate();
+    }
+
+    if (TraceRecorder::instance().isRecording()) {
+        TraceRecorder::instance().addFrameMarker(frameIndex, now());
+    }
+
+    pushScope("frame");
+}
+
+void Profiler::endFrame() {
+    popScope();
+
+    // Move to the next slot, whose queries were issued FRAMES_IN_FLIGHT frames ago
+    frameIndex++;
+    Frame &next = frames[frameIndex % FRAMES_IN_FLIGHT];
+    if (!next.entries.empty()) {
+        resolve(next);
+    }
+    next.index = frameIndex;
+    next.entries.clear();
+    next.numQueries = 0;
+    next.gpuCalibration = gpuCalibration;
+    next.cpuCalibration = cpuCalibration;
+}
+
+void Profiler::finish() {
+    // Wait for all the frames in flight from the oldest one (e.g., before dumping at exit)
+    for (int i = FRAMES_IN_FLIGHT - 1; i >= 1; i--) {
+        Frame &frame = frames[(frameIndex + FRAMES_IN_FLIGHT - i) % FRAMES_IN_FLIGHT];
+        if (frameIndex - i >= 0 && !frame.entries.empty()) {
+            resolve(frame);
+            frame.entries.clear();
+            frame.numQueries = 0;
+        }
+    }
+}
+
+void Profiler::pushScope(const char *name) {
+    if (std::this_thread::get_id() != glThread) {
+        workerStack.emplace_back(name, now());
+        return;
+    }
+
+    if (hasDebugGroups()) {
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+    }
+
+    if (!enabled) {
+        stack.push_back(-1);
+        return;
+    }
+
+    if (gpuCalibration < 0) {
+        calibrate();
+    }
+
+    Frame &frame = frames[frameIndex % FRAMES_IN_FLIGHT];
+    if (frame.numQueries * 2 + 2 > (int)frame.queries.size()) {
+        const size_t oldSize = frame.queries.size();
+        frame.queries.resize(std::max((size_t)16, oldSize * 2));
+        glGenQueries((GLsizei)(frame.queries.size() - oldSize), &frame.queries[oldSize]);
+    }
+
+    Entry entry;
+    entry.name = name;
+    entry.depth = (int)std::count_if(stack.begin(), stack.end(), [](int i) { return i >= 0; });
+    entry.query = frame.numQueries++;
+    entry.cpuStart = now();
+    entry.cpuEnd = entry.cpuStart;
+    glQueryCounter(frame.queries[entry.query * 2 + 0], GL_TIMESTAMP);
+
+    stack.push_back((int)frame.entries.size());
+    frame.entries.push_back(entry);
+}
+
+void Profiler::popScope() {
+    if (std::this_thread::get_id() != glThread) {
+        if (!workerStack.empty()) {
+            const auto scope = workerStack.back();
+            workerStack.pop_back();
+            TraceRecorder::instance().addCpuEvent(scope.first, scope.second, now() - scope.second);
+        }
+        return;
+    }
+
+    if (stack.empty()) {
+        return;
+    }
+
+    const int index = stack.back();
+    stack.pop_back();
+
+    if (index >= 0) {
+        Frame &frame = frames[frameIndex % FRAMES_IN_FLIGHT];
+        Entry &entry = frame.entries[index];
+        glQueryCounter(frame.queries[entry.query * 2 + 1], GL_TIMESTAMP);
+        entry.cpuEnd = now();
+    }
+
+    if (hasDebugGroups()) {
+        glPopDebugGroup();
+    }
+}
+
+void Profiler::resolve(Frame &frame) {
+    // The queries are FRAMES_IN_FLIGHT frames old, so this rarely waits
+    TraceRecorder &trace = TraceRecorder::instance();
+    resolved.clear();
+    for (const auto &entry : frame.entries) {
+        GLint64 start, end;
+        glGetQueryObjecti64v(frame.queries[entry.query * 2 + 0], GL_QUERY_RESULT, &start);
+        glGetQueryObjecti64v(frame.queries[entry.query * 2 + 1], GL_QUERY_RESULT, &end);
+        Record record;
+        record.name = entry.name;
+        record.depth = entry.depth;
+        record.cpuStart = entry.cpuStart;
+        record.cpuTime = entry.cpuEnd - entry.cpuStart;
+        record.gpuStart = frame.cpuCalibration + (start - frame.gpuCalibration) / 1000000.0;
+        record.gpuTime = (end - start) / 1000000.0;
+        resolved.push_back(record);
+
+        if (trace.isRecording()) {
+            trace.addCpuEvent(record.name, record.cpuStart, record.cpuTime);
+            trace.addGpuEvent(record.name, record.gpuStart, record.gpuTime);
+        }
+    }
+    resolvedFrame = frame.index;
+}
+
+void Profiler::dump() const {
+    if (resolved.empty()) {
+        printf("Profiler: no frame is resolved yet\n");
+        return;
+    }
+
+    printf("Profiler: frame %d\n", resolvedFrame);
+    printf("  %-32s %10s %10s\n", "scope", "CPU [ms]", "GPU [ms]");
+    for (const auto &record : resolved) {
+        const std::string label = std::string(2 * record.depth, ' ') + record.name;
+        printf("  %-32s %10.3f %10.3f\n", label.c_str(), record.cpuTime, record.gpuTime);
+    }
+}
+
+void Profiler::drawOverlay(int width, int height) const {
+    // Flame graph of the GPU timeline (upper bar) and CPU timeline (lower bar) drawn by scissored clears
+    if (resolved.empty()) {
+        return;
+    }
+
+    static const int rowHeight = 12;
+    static const int margin = 8;
+
+    GLfloat clearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    glEnable(GL_SCISSOR_TEST);
+
+    // Scale the bars by the root scope opened by "beginFrame"
+    const auto it = std::find_if(resolved.begin(), resolved.end(), [](const Record &r) { return r.depth == 0 && r.name == "frame"; });
+    const Record &root = it != resolved.end() ? *it : resolved[0];
+    const float graphWidth = float(width - 2 * margin);
+    const float gpuScale = root.gpuTime > 0.0 ? graphWidth / float(root.gpuTime) : 0.0f;
+    const float cpuScale = root.cpuTime > 0.0 ? graphWidth / float(root.cpuTime) : 0.0f;
+
+    for (const auto &record : resolved) {
+        const int y = height - margin - (record.depth + 1) * rowHeight;
+        if (y < 0) {
+            continue;
+        }
+
+        const glm::vec3 color = scopeColor(record.name);
+        glClearColor(color.x, color.y, color.z, 1.0f);
+
+        const int gx = margin + int(float(record.gpuStart - root.gpuStart) * gpuScale);
+        const int gw = std::max(1, int(float(record.gpuTime) * gpuScale));
+        glScissor(gx, y + 4, gw, rowHeight - 5);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        const int cx = margin + int(float(record.cpuStart - root.cpuStart) * cpuScale);
+        const int cw = std::max(1, int(float(record.cpuTime) * cpuScale));
+        glScissor(cx, y + 1, cw, 2);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+    glDisable(GL_SCISSOR_TEST);
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+}
+
+ProfileScope::ProfileScope(const char *name) {
+    Profiler::instance().pushScope(name);
+}
+
+ProfileScope::~ProfileScope() {
+    Profiler::instance().popScope();
+}
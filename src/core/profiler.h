@@ -0,0 +1,118 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/common.h"
+
+/**
+ * Hierarchical profiler of named scopes. Each scope records CPU wall time and
+ * GPU time (timestamp queries) and is also emitted as a KHR_debug group so
+ * that external GPU profilers show the same structure. GPU results are read
+ * back a few frames later, so the reported tree is that of a past frame.
+ * Scopes opened by threads other than the GL thread record CPU time only
+ * (to the trace recorder).
+ */
+class Profiler {
+public:
+    struct Record {
+        std::string name;
+        int depth = 0;
+        double cpuStart = 0.0;  // in milliseconds from the profiler epoch
+        double cpuTime = 0.0;   // in milliseconds
+        double gpuStart = 0.0;  // in milliseconds from the profiler epoch (calibrated GPU clock)
+        double gpuTime = 0.0;   // in milliseconds
+    };
+
+    static const int FRAMES_IN_FLIGHT = 4;
+
+    static Profiler &instance();
+
+    void beginFrame();
+    void endFrame();
+    void finish();
+    void pushScope(const char *name);
+    void popScope();
+    double now() const;
+
+    void dump() const;
+    void drawOverlay(int width, int height) const;
+
+    bool isEnabled() const {
+        return enabled;
+    }
+
+    void setEnabled(bool enabled) {
+        this->enabled = enabled;
+    }
+
+    bool isOverlayEnabled() const {
+        return overlayEnabled;
+    }
+
+    void setOverlayEnabled(bool enabled) {
+        this->overlayEnabled = enabled;
+    }
+
+    int resolvedFrameIndex() const {
+        return resolvedFrame;
+    }
+
+    const std::vector<Record> &resolvedRecords() const {
+        return resolved;
+    }
+
+private:
+    struct Entry {
+        const char *name;
+        int depth;
+        double cpuStart, cpuEnd;
+        int query;  // index of the query pair in the frame
+    };
+
+    struct Frame {
+        int index = -1;
+        std::vector<Entry> entries;
+        std::vector<GLuint> queries;
+        int numQueries = 0;
+        GLint64 gpuCalibration = 0;
+        double cpuCalibration = 0.0;
+    };
+
+    Profiler();
+
+    void calibrate();
+    void resolve(Frame &frame);
+
+    bool enabled = false;
+    bool overlayEnabled = false;
+
+    std::chrono::high_resolution_clock::time_point epoch;
+    std::thread::id glThread;
+
+    // GPU time stamp and CPU time taken at the same moment
+    GLint64 gpuCalibration = -1;
+    double cpuCalibration = 0.0;
+
+    Frame frames[FRAMES_IN_FLIGHT];
+    int frameIndex = 0;
+    std::vector<int> stack;
+
+    int resolvedFrame = -1;
+    std::vector<Record> resolved;
+};
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char *name);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name)
@@ -1,22 +1,20 @@
 #include "shader_program.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <experimental/filesystem>
 
-ShaderProgram::ShaderProgram() {
-}
+namespace fs = std::experimental::filesystem;
 
-ShaderProgram::~ShaderProgram() {
-}
+namespace {
 
-void ShaderProgram::create() {
-    programId = glCreateProgram();
-}
-
-void ShaderProgram::addShaderFromFile(const std::string& filename, ShaderType type) {
-    std::ifstream reader(filename.c_str(), std::ios::in);
+std::string readShaderSource(const fs::path &filename) {
+    std::ifstream reader(filename.string().c_str(), std::ios::in);
     if (reader.fail()) {
-        throw std::runtime_error("Failed to open shader source: " + filename);
+        throw std::runtime_error("Failed to open shader source: " + filename.string());
     }
 
     std::string code;
@@ -26,38 +24,157 @@ void ShaderProgram::addShaderFromFile(const std::string& filename, ShaderType ty
     code.assign(std::istreambuf_iterator<char>(reader), std::istreambuf_iterator<char>());
     reader.close();
 
-    addShaderFromSource(code, type);
+    // Resolve #include "..." directives relative to the including file
+    std::stringstream ss(code);
+    std::string line, result;
+    while (std::getline(ss, line)) {
+        const size_t pos = line.find("#include");
+        if (pos != std::string::npos && line.find_first_not_of(" \t") == pos) {
+            const size_t beg = line.find('"', pos);
+            const size_t end = line.find('"', beg + 1);
+            if (beg == std::string::npos || end == std::string::npos) {
+                FatalError("Invalid #include directive in %s: %s", filename.string().c_str(), line.c_str());
+            }
+            result += readShaderSource(filename.parent_path() / line.substr(beg + 1, end - beg - 1));
+            result += "\n";
+        } else {
+            result += line + "\n";
+        }
+    }
+
+    return result;
 }
 
-void ShaderProgram::addShaderFromSource(const std::string& source, ShaderType type) {
-    GLuint shaderId = glCreateShader((GLuint)type);
+// 64-bit FNV-1a
+uint64_t hashString(const std::string &str, uint64_t hash = 0xcbf29ce484222325ull) {
+    for (const char c : str) {
+        hash ^= (uint64_t)(unsigned char)c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
 
-    const char *codePtr = source.c_str();
-    glShaderSource(shaderId, 1, &codePtr, nullptr);
-    glCompileShader(shaderId);
+std::string glString(GLenum name) {
+    const GLubyte *str = glGetString(name);
+    return str != nullptr ? std::string((const char *)str) : std::string();
+}
 
-    GLint compileStatus;
-    glGetShaderiv(shaderId, GL_COMPILE_STATUS, &compileStatus);
-    if (compileStatus == GL_FALSE) {
-        GLint logLength;
-        glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &logLength);
-        if (logLength > 0) {
-            GLsizei length;
-            std::string errMsg;
-            errMsg.resize((size_t)logLength);
-            glGetShaderInfoLog(shaderId, logLength, &length, &errMsg[0]);
-            fprintf(stderr, "%s\n", errMsg.c_str());
-            fprintf(stderr, "%s\n", source.c_str());
+double elapsedMilliseconds(const std::chrono::high_resolution_clock::time_point &start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+}  // anonymous namespace
+
+std::string ShaderProgram::binaryCacheDir = "";
+ShaderCacheStatistics ShaderProgram::cacheStats;
+bool ShaderProgram::parallelCompile = false;
+
+ShaderProgram::ShaderProgram() {
+}
+
+ShaderProgram::~ShaderProgram() {
+}
+
+void ShaderProgram::create() {
+    programId = glCreateProgram();
+}
+
+void ShaderProgram::addShaderFromFile(const std::string& filename, ShaderType type, const std::vector<std::string> &defines) {
+    std::string code = readShaderSource(fs::path(filename.c_str()));
+
+    // Macro definitions (e.g., "NAME VALUE") are inserted just after the #version line
+    if (!defines.empty()) {
+        std::string defineLines;
+        for (const auto &def : defines) {
+            defineLines += "#define " + def + "\n";
         }
-        FatalError("Failed to compile a shader!");
+
+        size_t pos = code.find("#version");
+        pos = pos != std::string::npos ? code.find('\n', pos) : std::string::npos;
+        pos = pos != std::string::npos ? pos + 1 : 0;
+        code.insert(pos, defineLines);
     }
 
-    glAttachShader(programId, shaderId);
+    addShaderFromSource(code, type);
+}
+
+void ShaderProgram::addShaderFromSource(const std::string& source, ShaderType type) {
+    // Compilation is deferred to "link", which may load a cached binary instead
+    sources.emplace_back(type, source);
 }
 
 void ShaderProgram::link() {
+    std::string cacheFile = "";
+    if (!binaryCacheDir.empty()) {
+        GLint numFormats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+        if (numFormats > 0) {
+            cacheFile = (fs::path(binaryCacheDir) / (binaryCacheKey() + ".bin")).string();
+        }
+    }
+
+    // Cached binary (rejected by the driver if it does not match anymore)
+    if (!cacheFile.empty()) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        const bool loaded = loadBinary(cacheFile);
+        cacheStats.loadTime += elapsedMilliseconds(start);
+        if (loaded) {
+            cacheStats.numLoaded++;
+            sources.clear();
+            cacheUniformLocations();
+            return;
+        }
+    }
+
+    // Compile and link without waiting for the result (driver threads may work on it in the background)
+    const auto start = std::chrono::high_resolution_clock::now();
+    if (!cacheFile.empty()) {
+        glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    for (const auto &src : sources) {
+        GLuint shaderId = glCreateShader((GLuint)src.first);
+
+        const char *codePtr = src.second.c_str();
+        glShaderSource(shaderId, 1, &codePtr, nullptr);
+        glCompileShader(shaderId);
+
+        glAttachShader(programId, shaderId);
+        pendingShaderIds.push_back(shaderId);
+    }
     glLinkProgram(programId);
 
+    linkPending = true;
+    pendingCacheFile = cacheFile;
+    cacheStats.numPending++;
+    cacheStats.compileTime += elapsedMilliseconds(start);
+}
+
+void ShaderProgram::completeLink() {
+    const auto start = std::chrono::high_resolution_clock::now();
+    linkPending = false;
+    cacheStats.numPending--;
+
+    for (size_t i = 0; i < pendingShaderIds.size(); i++) {
+        const GLuint shaderId = pendingShaderIds[i];
+
+        GLint compileStatus;
+        glGetShaderiv(shaderId, GL_COMPILE_STATUS, &compileStatus);
+        if (compileStatus == GL_FALSE) {
+            GLint logLength;
+            glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &logLength);
+            if (logLength > 0) {
+                GLsizei length;
+                std::string errMsg;
+                errMsg.resize((size_t)logLength);
+                glGetShaderInfoLog(shaderId, logLength, &length, &errMsg[0]);
+                fprintf(stderr, "%s\n", errMsg.c_str());
+                fprintf(stderr, "%s\n", sources[i].second.c_str());
+            }
+            FatalError("Failed to compile a shader!");
+        }
+    }
+
     GLint linkStatus;
     glGetProgramiv(programId, GL_LINK_STATUS, &linkStatus);
 
@@ -73,9 +190,135 @@ void ShaderProgram::link() {
         }
         FatalError("Failed to link shaders!");
     }
+
+    // Shader objects are no longer needed once the program is linked
+    for (GLuint shaderId : pendingShaderIds) {
+        glDetachShader(programId, shaderId);
+        glDeleteShader(shaderId);
+    }
+    pendingShaderIds.clear();
+
+    cacheStats.compileTime += elapsedMilliseconds(start);
+    cacheStats.numCompiled++;
+
+    if (!pendingCacheFile.empty()) {
+        saveBinary(pendingCacheFile);
+    }
+    sources.clear();
+    cacheUniformLocations();
+}
+
+bool ShaderProgram::enableParallelCompile() {
+    // Let the driver choose the number of compiler threads
+    if (GLAD_GL_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+        parallelCompile = true;
+    } else if (GLAD_GL_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+        parallelCompile = true;
+    }
+    return parallelCompile;
+}
+
+std::string ShaderProgram::binaryCacheKey() const {
+    // Binaries are only valid for the same sources on the same driver
+    uint64_t hash = hashString(glString(GL_VENDOR));
+    hash = hashString(glString(GL_RENDERER), hash);
+    hash = hashString(glString(GL_VERSION), hash);
+    for (const auto &src : sources) {
+        hash = hashString(std::to_string((uint32_t)src.first), hash);
+        hash = hashString(src.second, hash);
+    }
+
+    char key[32];
+    sprintf(key, "%016llx", (unsigned long long)hash);
+    return key;
+}
+
+bool ShaderProgram::loadBinary(const std::string &filename) {
+    std::ifstream reader(filename.c_str(), std::ios::in | std::ios::binary);
+    if (reader.fail()) {
+        return false;
+    }
+
+    GLenum format = 0;
+    reader.read((char *)&format, sizeof(GLenum));
+    const std::string binary((std::istreambuf_iterator<char>(reader)), std::istreambuf_iterator<char>());
+    reader.close();
+    if (binary.empty()) {
+        return false;
+    }
+
+    glProgramBinary(programId, format, binary.data(), (GLsizei)binary.size());
+
+    GLint linkStatus;
+    glGetProgramiv(programId, GL_LINK_STATUS, &linkStatus);
+    return linkStatus == GL_TRUE;
+}
+
+void ShaderProgram::saveBinary(const std::string &filename) {
+    GLint length = 0;
+    glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    GLenum format = 0;
+    std::string binary((size_t)length, '\0');
+    glGetProgramBinary(programId, length, &length, &format, &binary[0]);
+
+    // Failing to write the cache is not fatal (the program is compiled again next time)
+    std::error_code ec;
+    fs::create_directories(fs::path(filename).parent_path(), ec);
+    std::ofstream writer(filename.c_str(), std::ios::out | std::ios::binary);
+    if (writer.fail()) {
+        fprintf(stderr, "Failed to write program binary: %s\n", filename.c_str());
+        return;
+    }
+    writer.write((const char *)&format, sizeof(GLenum));
+    writer.write(binary.data(), length);
+}
+
+void ShaderProgram::cacheUniformLocations() {
+    uniformLocations.clear();
+
+    GLint numUniforms = 0, maxNameLength = 0;
+    glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &numUniforms);
+    glGetProgramiv(programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    std::string name(std::max(maxNameLength, 1), '\0');
+    for (GLint i = 0; i < numUniforms; i++) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type;
+        glGetActiveUniform(programId, (GLuint)i, maxNameLength, &length, &size, &type, &name[0]);
+
+        // Members of uniform blocks have no location
+        const std::string uniformName = name.substr(0, length);
+        const GLint location = glGetUniformLocation(programId, uniformName.c_str());
+        if (location < 0) {
+            continue;
+        }
+        uniformLocations[uniformName] = location;
+
+        // Arrays are reported as "name[0]", but are also set by "name"
+        const size_t bracket = uniformName.find('[');
+        if (bracket != std::string::npos) {
+            uniformLocations[uniformName.substr(0, bracket)] = location;
+        }
+    }
 }
 
 void ShaderProgram::destroy() {
+    for (GLuint shaderId : pendingShaderIds) {
+        glDeleteShader(shaderId);
+    }
+    pendingShaderIds.clear();
+    if (linkPending) {
+        cacheStats.numPending--;
+        linkPending = false;
+    }
+
     if (programId != 0) {
         glDeleteProgram(programId);
     }
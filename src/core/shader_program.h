@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "core/common.h"
 
@@ -13,120 +15,172 @@ enum class ShaderType : uint32_t {
     Compute = GL_COMPUTE_SHADER
 };
 
+//! Statistics of the program binary cache (accumulated over all programs)
+struct ShaderCacheStatistics {
+    int numCompiled = 0;        // programs compiled from source
+    int numLoaded = 0;          // programs loaded from cached binaries
+    int numPending = 0;         // programs submitted, but not used (and checked) yet
+    double compileTime = 0.0;   // [ms] compile and link from source (time spent waiting for the driver)
+    double loadTime = 0.0;      // [ms] glProgramBinary (including failed attempts)
+};
+
+// ----------------------------------------------------------------------------
+// Uniform upload to a program without binding it (glProgramUniform*)
+// ----------------------------------------------------------------------------
+
+inline void setProgramUniform(GLuint programId, GLint location, float v) { glProgramUniform1f(programId, location, v); }
+inline void setProgramUniform(GLuint programId, GLint location, const glm::vec2 &v) { glProgramUniform2fv(programId, location, 1, glm::value_ptr(v)); }
+inline void setProgramUniform(GLuint programId, GLint location, const glm::vec3 &v) { glProgramUniform3fv(programId, location, 1, glm::value_ptr(v)); }
+inline void setProgramUniform(GLuint programId, GLint location, const glm::vec4 &v) { glProgramUniform4fv(programId, location, 1, glm::value_ptr(v)); }
+inline void setProgramUniform(GLuint programId, GLint location, int v) { glProgramUniform1i(programId, location, v); }
+inline void setProgramUniform(GLuint programId, GLint location, const glm::ivec2 &v) { glProgramUniform2iv(programId, location, 1, glm::value_ptr(v)); }
+inline void setProgramUniform(GLuint programId, GLint location, const glm::ivec3 &v) { glProgramUniform3iv(programId, location, 1, glm::value_ptr(v)); }
+inline void setProgramUniform(GLuint programId, GLint location, const glm::ivec4 &v) { glProgramUniform4iv(programId, location, 1, glm::value_ptr(v)); }
+inline void setProgramUniform(GLuint programId, GLint location, const glm::mat4 &m) { glProgramUniformMatrix4fv(programId, location, 1, GL_FALSE, glm::value_ptr(m)); }
+
+/**
+ * Typed handle of a uniform variable, whose location is resolved only once.
+ * Setting a value neither binds the program nor looks up the name.
+ */
+template <typename T>
+class Uniform {
+public:
+    Uniform() {}
+    Uniform(GLuint programId, GLint location)
+        : programId{ programId }
+        , location{ location } {
+    }
+
+    void set(const T &v) const {
+        if (location >= 0) {
+            setProgramUniform(programId, location, v);
+        }
+    }
+
+    bool isActive() const { return location >= 0; }
+
+private:
+    GLuint programId = 0u;
+    GLint location = -1;
+};
+
 class ShaderProgram {
 public:
     ShaderProgram();
     virtual ~ShaderProgram();
 
     void create();
-    void addShaderFromFile(const std::string &filename, ShaderType type);
+    void addShaderFromFile(const std::string &filename, ShaderType type, const std::vector<std::string> &defines = {});
     void addShaderFromSource(const std::string &source, ShaderType type);
     void link();
     void destroy();
 
-    void bind() { glUseProgram(programId); }
-    void release() { glUseProgram(0); }
-
-    GLint getUniformLocation(const std::string& name) {
-        GLint currentProgramId;
-        glGetIntegerv(GL_CURRENT_PROGRAM, &currentProgramId);
-        if (currentProgramId != programId) {
-            FatalError("Uniform variable %s i set before program is used!", name.c_str());
+    // "link" only submits the compilation, which finishes when the program is first used
+    void finishLink() {
+        if (linkPending) {
+            completeLink();
         }
-        return glGetUniformLocation(programId, name.c_str());
     }
 
-    void setUniformValue(const std::string &name, float v) {
-        const GLint location = getUniformLocation(name);
-        if (location >= 0) {
-            glUniform1f(location, v);
-        }
-    }
+    // Shaders are compiled by driver threads (KHR/ARB_parallel_shader_compile) if available
+    static bool enableParallelCompile();
 
-    void setUniformValue(const std::string &name, const glm::vec2& v) {
-        const GLint location = getUniformLocation(name);
-        if (location >= 0) {
-            glUniform2fv(location, 1, glm::value_ptr(v));
-        }
-    }
+    // Linked binaries are cached in this directory (empty: disabled)
+    static void setBinaryCacheDirectory(const std::string &dirname) { binaryCacheDir = dirname; }
+    static const std::string &binaryCacheDirectory() { return binaryCacheDir; }
+    static const ShaderCacheStatistics &cacheStatistics() { return cacheStats; }
 
-    void setUniformValue(const std::string& name, const glm::vec3& v) {
-        const GLint location = getUniformLocation(name);
-        if (location >= 0) {
-            glUniform3fv(location, 1, glm::value_ptr(v));
-        }
+    void bind() {
+        finishLink();
+        glUseProgram(programId);
     }
 
-    void setUniformValue(const std::string& name, const glm::vec4& v) {
-        const GLint location = getUniformLocation(name);
-        if (location >= 0) {
-            glUniform4fv(location, 1, glm::value_ptr(v));
-        }
-    }
+    void release() { glUseProgram(0); }
 
-    void setUniformValue(const std::string& name, int v) {
-        const GLint location = getUniformLocation(name);
-        if (location >= 0) {
-            glUniform1i(location, v);
-        }
-    }
+    GLuint getId() const { return programId; }
 
-    void setUniformValue(const std::string& name, const glm::ivec2& v) {
-        const GLint location = getUniformLocation(name);
-        if (location >= 0) {
-            glUniform2iv(location, 1, glm::value_ptr(v));
-        }
+    GLint getUniformLocation(const std::string &name) {
+        // Locations are cached after "link" (-1 for inactive variables)
+        finishLink();
+        const auto it = uniformLocations.find(name);
+        return it != uniformLocations.end() ? it->second : -1;
     }
 
-    void setUniformValue(const std::string& name, const glm::ivec3& v) {
-        const GLint location = getUniformLocation(name);
-        if (location >= 0) {
-            glUniform3iv(location, 1, glm::value_ptr(v));
-        }
+    template <typename T>
+    Uniform<T> uniform(const std::string &name) {
+        return Uniform<T>(programId, getUniformLocation(name));
     }
 
-    void setUniformValue(const std::string& name, const glm::ivec4& v) {
+    void setUniformValue(const std::string &name, float v) { setUniform(name, v); }
+    void setUniformValue(const std::string &name, const glm::vec2 &v) { setUniform(name, v); }
+    void setUniformValue(const std::string &name, const glm::vec3 &v) { setUniform(name, v); }
+    void setUniformValue(const std::string &name, const glm::vec4 &v) { setUniform(name, v); }
+    void setUniformValue(const std::string &name, int v) { setUniform(name, v); }
+    void setUniformValue(const std::string &name, const glm::ivec2 &v) { setUniform(name, v); }
+    void setUniformValue(const std::string &name, const glm::ivec3 &v) { setUniform(name, v); }
+    void setUniformValue(const std::string &name, const glm::ivec4 &v) { setUniform(name, v); }
+    void setUniformValue(const std::string &name, const glm::mat4 &m) { setUniform(name, m); }
+
+    void setUniformValueArray(const std::string& name, const int* values, int count) {
         const GLint location = getUniformLocation(name);
         if (location >= 0) {
-            glUniform4iv(location, 1, glm::value_ptr(v));
-        }
-    }
-
-    void setUniformValue(const std::string& name, const glm::mat4& m) {
-        const GLint location = getUniformLocation(name);
-        if (location >= 0) {
-            glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(m));
+            glProgramUniform1iv(programId, location, count, values);
         }
     }
 
     void setUniformValueArray(const std::string& name, const float* values, int count) {
         const GLint location = getUniformLocation(name);
         if (location >= 0) {
-            glUniform1fv(location, count, values);
+            glProgramUniform1fv(programId, location, count, values);
         }
     }
 
     void setUniformValueArray(const std::string& name, const glm::vec2* values, int count) {
         const GLint location = getUniformLocation(name);
         if (location >= 0) {
-            glUniform2fv(location, count, (GLfloat*)values);
+            glProgramUniform2fv(programId, location, count, (GLfloat*)values);
         }
     }
 
     void setUniformValueArray(const std::string& name, const glm::vec3* values, int count) {
-        const GLuint location = getUniformLocation(name);
+        const GLint location = getUniformLocation(name);
         if (location >= 0) {
-            glUniform3fv(location, count, (GLfloat*)values);
+            glProgramUniform3fv(programId, location, count, (GLfloat*)values);
         }
     }
 
     void setUniformValueArray(const std::string& name, const glm::vec4* values, int count) {
         const GLint location = getUniformLocation(name);
         if (location >= 0) {
-            glUniform4fv(location, count, (GLfloat*)values);
+            glProgramUniform4fv(programId, location, count, (GLfloat*)values);
         }
     }
 
 private:
+    template <typename T>
+    void setUniform(const std::string &name, const T &v) {
+        const GLint location = getUniformLocation(name);
+        if (location >= 0) {
+            setProgramUniform(programId, location, v);
+        }
+    }
+
+    void completeLink();
+    bool loadBinary(const std::string &filename);
+    void saveBinary(const std::string &filename);
+    std::string binaryCacheKey() const;
+    void cacheUniformLocations();
+
     GLuint programId;
+    std::vector<std::pair<ShaderType, std::string>> sources;
+    std::unordered_map<std::string, GLint> uniformLocations;
+
+    // Compile and link submitted, but the result has not been checked yet
+    bool linkPending = false;
+    std::vector<GLuint> pendingShaderIds;
+    std::string pendingCacheFile;
+
+    static std::string binaryCacheDir;
+    static ShaderCacheStatistics cacheStats;
+    static bool parallelCompile;
 };
@@ -0,0 +1,121 @@
+#include "surface_scene.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+
+#include "common.h"
+
+SurfaceScene SurfaceScene::fromMesh(MeshData mesh) {
+    SurfaceScene scene;
+    scene.meshes.push_back(std::move(mesh));
+    scene.instances.push_back(SurfaceInstance());
+    return scene;
+}
+
+SurfaceScene SurfaceScene::load(const std::string &filename) {
+    std::ifstream reader(filename.c_str(), std::ios::in);
+    if (reader.fail()) {
+        FatalError("Failed to load scene file: %s", filename.c_str());
+    }
+
+    const fs::path rootDir = fs::absolute(fs::path(filename.c_str()).parent_path());
+    std::vector<std::string> meshFiles;
+    SurfaceScene scene;
+
+    std::string line;
+    int lineNumber = 0;
+    int material = 0;
+    while (std::getline(reader, line)) {
+        lineNumber++;
+        std::stringstream ss(line);
+        std::string type;
+        if (!(ss >> type) || type[0] == '#') {
+            continue;
+        }
+
+        if (type == "mesh") {
+            std::string path;
+            if (!(ss >> path)) {
+                FatalError("%s:%d: mesh file is missing!", filename.c_str(), lineNumber);
+            }
+            meshFiles.push_back(fs::canonical(rootDir / fs::path(path.c_str())).string());
+        } else if (type == "material") {
+            SurfaceMaterial mat;
+            std::string roughness;
+            if (!(ss >> roughness >> mat.eta.x >> mat.eta.y >> mat.eta.z >> mat.kappa.x >> mat.kappa.y >> mat.kappa.z)) {
+                FatalError("%s:%d: expected \"material <roughness> <eta R G B> <kappa R G B>\"!", filename.c_str(), lineNumber);
+            }
+            mat.roughnessTextured = roughness == "texture";
+            if (!mat.roughnessTextured && sscanf(roughness.c_str(), "%f", &mat.roughness) != 1) {
+                FatalError("%s:%d: roughness \"%s\" is neither a number nor \"texture\"!", filename.c_str(), lineNumber, roughness.c_str());
+            }
+            ss >> mat.diffColor.x >> mat.diffColor.y >> mat.diffColor.z >> mat.vertexRateThreshold;
+            scene.materials.push_back(mat);
+        } else if (type == "usematerial") {
+            if (!(ss >> material)) {
+                FatalError("%s:%d: material index is missing!", filename.c_str(), lineNumber);
+            }
+        } else if (type == "instance") {
+            SurfaceInstance instance;
+            instance.material = material;
+            glm::vec3 translation;
+            float rotation = 0.0f;
+            float scale = 1.0f;
+            if (!(ss >> instance.mesh >> translation.x >> translation.y >> translation.z)) {
+                FatalError("%s:%d: expected \"instance <mesh> <x> <y> <z>\"!", filename.c_str(), lineNumber);
+            }
+            ss >> rotation >> scale;
+            instance.transform = glm::translate(translation) *
+                                 glm::rotate(glm::radians(rotation), glm::vec3(0.0f, 1.0f, 0.0f)) *
+                                 glm::scale(glm::vec3(scale));
+            scene.instances.push_back(instance);
+        } else if (type == "grid") {
+            int mesh, countX, countZ;
+            float spacing;
+            float y = 0.0f;
+            if (!(ss >> mesh >> countX >> countZ >> spacing)) {
+                FatalError("%s:%d: expected \"grid <mesh> <count X> <count Z> <spacing>\"!", filename.c_str(), lineNumber);
+            }
+            ss >> y;
+            for (int z = 0; z < countZ; z++) {
+                for (int x = 0; x < countX; x++) {
+                    SurfaceInstance instance;
+                    instance.mesh = mesh;
+                    instance.material = material;
+                    instance.transform = glm::translate(glm::vec3((x - 0.5f * (countX - 1)) * spacing, y,
+                                                                  (z - 0.5f * (countZ - 1)) * spacing));
+                    scene.instances.push_back(instance);
+                }
+            }
+        } else {
+            FatalError("%s:%d: unknown entry \"%s\"!", filename.c_str(), lineNumber, type.c_str());
+        }
+    }
+
+    for (const auto &instance : scene.instances) {
+        if (instance.mesh < 0 || instance.mesh >= (int)meshFiles.size()) {
+            FatalError("%s: instance of undefined mesh %d!", filename.c_str(), instance.mesh);
+        }
+        if (instance.material < 0 || instance.material > (int)scene.materials.size()) {
+            FatalError("%s: instance of undefined material %d!", filename.c_str(), instance.material);
+        }
+    }
+
+    for (const auto &meshFile : meshFiles) {
+        scene.meshes.push_back(MeshData::load(meshFile));
+    }
+
+    return scene;
+}
+
+size_t SurfaceScene::numTriangles() const {
+    size_t count = 0;
+    for (const auto &instance : instances) {
+        count += meshes[instance.mesh].indices.size() / 3;
+    }
+    return count;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "core/vertex_array_object.h"
+
+//! Microfacet reflector with Fresnel reflectance of a conductor (kappa = 0: dielectric) and a diffuse term
+struct SurfaceMaterial {
+    glm::vec3 eta = glm::vec3(0.049889f, 0.053285f, 0.049317f);  // index of refraction (default: silver)
+    glm::vec3 kappa = glm::vec3(4.4869f, 3.4101f, 2.8545f);      // extinction coefficient (default: silver)
+    glm::vec3 diffColor = glm::vec3(0.0f);
+    float roughness = 0.001f;
+    bool roughnessTextured = true;  // GGX alpha from the roughness texture instead of "roughness"
+    float vertexRateThreshold = 0.3f;  // GGX alpha from which the vertex-rate indirect illumination is used
+};
+
+//! Placement of one of the meshes of "SurfaceScene"
+struct SurfaceInstance {
+    int mesh = 0;
+    int material = 0;
+    glm::mat4 transform = glm::mat4(1.0f);
+};
+
+//! Meshes and their instances, which "IndirectSurface" draws with a single multi-draw (can be loaded on any thread)
+struct SurfaceScene {
+    // One instance of the mesh without transformation
+    static SurfaceScene fromMesh(MeshData mesh);
+
+    /**
+     * Scene file with one entry per line ('#' starts a comment, paths are relative to the file):
+     *   mesh <OBJ file>                                   (indexed in the order of appearance)
+     *   instance <mesh> <x> <y> <z> [<rotation about Y in degrees> [<scale>]]
+     *   grid <mesh> <count X> <count Z> <spacing> [<y>]   (instances on the XZ plane, centered at the origin)
+     *   material <roughness | texture> <eta R G B> <kappa R G B> [<diffuse R G B> [<vertex-rate alpha>]]   (indexed from 1)
+     *   usematerial <material>                            (for the following instances, default: 0)
+     * Material 0 is the default material of "IndirectSurface", which precedes the "material" entries.
+     */
+    static SurfaceScene load(const std::string &filename);
+
+    size_t numTriangles() const;
+
+    std::vector<MeshData> meshes;
+    std::vector<SurfaceMaterial> materials;  // entries 1, 2, ... of the material table
+    std::vector<SurfaceInstance> instances;
+};
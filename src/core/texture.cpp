@@ -21,6 +21,20 @@ void imageFlip(T *bytes, int width, int height, int channels) {
 // PUBLIC methods
 // ---------------------------------------------------------------------------------------------------------------------
 
+ImageData ImageData::load(const std::string &filename) {
+    // UInt8 texture
+    ImageData image;
+    uint8_t *bytes = stbi_load(filename.c_str(), &image.width, &image.height, &image.channels, STBI_rgb_alpha);
+    if (!bytes) {
+        fprintf(stderr, "Failed to load image file: %s", filename.c_str());
+        exit(1);
+    }
+
+    image.pixels.assign(bytes, bytes + (size_t)image.width * image.height * 4);
+    stbi_image_free(bytes);
+    return image;
+}
+
 Texture::Texture()
     : width_{ 0 }
     , height_{ 0 }
@@ -35,6 +49,11 @@ Texture::Texture(const std::string &filename, bool generateMipMap)
     load(filename, generateMipMap);
 }
 
+Texture::Texture(const ImageData &image, bool generateMipMap)
+    : Texture{} {
+    setImage(image, generateMipMap);
+}
+
 Texture::Texture(int width, int height, GLenum internalFormat, GLenum format, GLenum type)
     : width_{ width }
     , height_{ height }
@@ -67,17 +86,18 @@ void Texture::clear(const glm::vec4 &color) {
 }
 
 void Texture::load(const std::string &filename, bool generateMipMap) {
+    setImage(ImageData::load(filename), generateMipMap);
+}
+
+void Texture::setImage(const ImageData &image, bool generateMipMap) {
+    width_ = image.width;
+    height_ = image.height;
+    channels_ = image.channels;
+
     // Texture setup
     glGenTextures(1, &textureId);
     glBindTexture(GL_TEXTURE_2D, textureId);
 
-    // UInt8 texture
-    uint8_t *bytes = stbi_load(filename.c_str(), &width_, &height_, &channels_, STBI_rgb_alpha);
-    if (!bytes) {
-        fprintf(stderr, "Failed to load image file: %s", filename.c_str());
-        exit(1);
-    }
-
     // Inversion
     //imageFlip(bytes, width_, height_, 4);
 
@@ -91,9 +111,7 @@ void Texture::load(const std::string &filename, bool generateMipMap) {
     }
 
     // Copy texture data
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, bytes);
-
-    stbi_image_free(bytes);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
 
     if (generateMipMap) {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -1,20 +1,31 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "common.h"
 
+//! RGBA8 image decoded on the CPU (can be loaded on any thread)
+struct ImageData {
+    static ImageData load(const std::string &filename);
+
+    int width = 0, height = 0, channels = 0;
+    std::vector<uint8_t> pixels;
+};
+
 class Texture {
 public:
     // PUBLIC methods
     Texture();
     explicit Texture(const std::string &filename, bool generateMipMap = false);
+    explicit Texture(const ImageData &image, bool generateMipMap = false);
     Texture(int width, int height, GLenum internalFormat = GL_RGBA8,
             GLenum format = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE);
     Texture(int width, int height);
     virtual ~Texture();
 
     void load(const std::string &filename, bool generateMipMap = false);
+    void setImage(const ImageData &image, bool generateMipMap = false);
 
     void clear(const glm::vec4 &color);
 
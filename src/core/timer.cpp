@@ -1,31 +1,86 @@
 #include "timer.h"
 
-GLtimer::GLtimer() {
-    glGenQueries(2, m_queryID);
+namespace {
+
+// Resolved durations which are not popped by the user are discarded beyond this
+const size_t MAX_RESULTS = 256;
 
+}  // anonymous namespace
+
+GLtimer::GLtimer() {
+    glGenQueries(QUERY_RING_SIZE * 2, &m_queryID[0][0]);
 }
 
 void GLtimer::start() {
-    glQueryCounter(m_queryID[0], GL_TIMESTAMP);
+    // All the queries are in flight, so wait for the oldest one
+    if (numPending() == QUERY_RING_SIZE) {
+        poll();
+        if (numPending() == QUERY_RING_SIZE) {
+            resolveOldest();
+        }
+    }
+
+    glQueryCounter(m_queryID[m_head % QUERY_RING_SIZE][0], GL_TIMESTAMP);
     m_frameIndex++;
 }
 
 void GLtimer::end() {
-    glQueryCounter(m_queryID[1], GL_TIMESTAMP);
+    glQueryCounter(m_queryID[m_head % QUERY_RING_SIZE][1], GL_TIMESTAMP);
+    m_head++;
+    poll();
+}
+
+int GLtimer::poll() {
+    // Read the results of the finished queries without blocking
+    int count = 0;
+    while (m_tail < m_head) {
+        GLint available = 0;
+        glGetQueryObjectiv(m_queryID[m_tail % QUERY_RING_SIZE][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        resolveOldest();
+        count++;
+    }
+    return count;
+}
+
+void GLtimer::wait() {
+    while (m_tail < m_head) {
+        resolveOldest();
+    }
+}
 
-    GLint stopTimerAvailable = 0;
-    while (!stopTimerAvailable) {
-        glGetQueryObjectiv(m_queryID[1], GL_QUERY_RESULT_AVAILABLE, &stopTimerAvailable);
+bool GLtimer::popResult(double &duration) {
+    if (m_results.empty()) {
+        return false;
     }
+    duration = m_results.front();
+    m_results.pop_front();
+    return true;
+}
 
-    glGetQueryObjecti64v(m_queryID[0], GL_QUERY_RESULT, &m_start);
-    glGetQueryObjecti64v(m_queryID[1], GL_QUERY_RESULT, &m_end);
+void GLtimer::resolveOldest() {
+    // GL_QUERY_RESULT blocks until the result is available
+    GLint64 start, end;
+    glGetQueryObjecti64v(m_queryID[m_tail % QUERY_RING_SIZE][0], GL_QUERY_RESULT, &start);
+    glGetQueryObjecti64v(m_queryID[m_tail % QUERY_RING_SIZE][1], GL_QUERY_RESULT, &end);
+    m_tail++;
 
-    m_duration += (m_end - m_start) / 1000000.0; // in milliseconds
+    const double duration = (end - start) / 1000000.0; // in milliseconds
+    m_duration += duration;
+    m_resolved++;
+
+    m_results.push_back(duration);
+    if (m_results.size() > MAX_RESULTS) {
+        m_results.pop_front();
+    }
 }
 
 void GLtimer::reset() {
+    // Pending queries are kept and counted after the reset
     m_duration = 0;
+    m_resolved = 0;
     m_frameIndex = 0;
 }
 
@@ -36,7 +91,8 @@ double GLtimer::getDuration() {
 }
 
 double GLtimer::getDuration(int frameNum) {
-    double tmp = m_duration / frameNum;
+    // Average over the resolved measurements (a few of the last "frameNum" frames may still be in flight)
+    double tmp = m_resolved > 0 ? m_duration / m_resolved : m_duration / frameNum;
     reset();
     return tmp;
 }
@@ -48,7 +104,7 @@ void GLtimer::showDuration() {
 
 void GLtimer::showDuration(int frameNum) {
     if (m_frameIndex % frameNum == 0) {
-        double aveDuration = m_duration / frameNum;
+        double aveDuration = m_resolved > 0 ? m_duration / m_resolved : m_duration / frameNum;
         printf("GLtimer aveDuration for %d frames : %lf [ms]\n", frameNum, aveDuration);
         printf("GLtimer aveFPS for %d frames : %lf [fps]\n", frameNum, 1000.0/aveDuration);
         reset();
@@ -1,23 +1,48 @@
 #pragma once
 
+#include <deque>
+
 #include "core/common.h"
 
+/**
+ * GPU timer based on timestamp queries. Queries are kept in a ring spanning
+ * a few frames in flight and their results are read only once available, so
+ * measuring does not stall the pipeline. Durations are therefore reported
+ * with a delay of up to QUERY_RING_SIZE measurements.
+ */
 class GLtimer {
 public:
+    static const int QUERY_RING_SIZE = 4;
+
     GLtimer();
 
     void start();
     void end();
+    int poll();
+    void wait();
+    bool popResult(double &duration);
     void reset();
     double getDuration();
     double getDuration(int frameNum);
     void showDuration();
     void showDuration(int frameNum);
+
+    int numPending() const {
+        return m_head - m_tail;
+    }
+
+    int numResolved() const {
+        return m_resolved;
+    }
+
 private:
-    unsigned int m_queryID[2];
-    GLint64 m_start;
-    GLint64 m_end;
-    GLint m_endAvailable;
-    double m_duration = 0.0;
+    void resolveOldest();
+
+    unsigned int m_queryID[QUERY_RING_SIZE][2];
+    int m_head = 0;             // # of issued measurements
+    int m_tail = 0;             // # of resolved measurements
+    std::deque<double> m_results;
+    double m_duration = 0.0;    // sum of the resolved durations since reset
+    int m_resolved = 0;         // # of the resolved durations since reset
     int m_frameIndex = 0;
 };
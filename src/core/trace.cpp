@@ -0,0 +1,109 @@
+#include "trace.h"
+
+#include <fstream>
+
+#include "core/common.h"
+
+namespace {
+
+const int CPU_PID = 1;
+const int GPU_PID = 2;
+
+}  // anonymous namespace
+
+TraceRecorder &TraceRecorder::instance() {
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+void TraceRecorder::start(const std::string &filename) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->filename = filename;
+    events.clear();
+    recording = true;
+
+    // The thread which starts recording is shown as "main"
+    threadIndex();
+}
+
+void TraceRecorder::stop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!recording) {
+        return;
+    }
+    recording = false;
+
+    std::ofstream writer(filename.c_str(), std::ios::out);
+    if (writer.fail()) {
+        FatalError("Failed to open file: %s", filename.c_str());
+    }
+
+    writer << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+
+    // Track names
+    writer << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << CPU_PID << ", \"args\": {\"name\": \"CPU\"}},\n";
+    writer << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << GPU_PID << ", \"args\": {\"name\": \"GPU\"}},\n";
+    writer << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << GPU_PID << ", \"tid\": 0, \"args\": {\"name\": \"GL queue\"}}";
+    for (int i = 0; i < (int)threadNames.size(); i++) {
+        writer << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << CPU_PID << ", \"tid\": " << i
+               << ", \"args\": {\"name\": \"" << escapeJson(threadNames[i]) << "\"}}";
+    }
+
+    // Events (time stamps are in microseconds)
+    writer.precision(3);
+    writer << std::fixed;
+    for (const auto &e : events) {
+        writer << ",\n{\"name\": \"" << escapeJson(e.name) << "\", \"ph\": \"" << e.phase << "\", \"pid\": " << e.pid
+               << ", \"tid\": " << e.tid << ", \"ts\": " << e.start * 1000.0;
+        if (e.phase == 'X') {
+            writer << ", \"dur\": " << e.duration * 1000.0;
+        } else {
+            writer << ", \"s\": \"g\"";
+        }
+        writer << "}";
+    }
+    writer << "\n]}\n";
+
+    printf("Save: %s (%d events)\n", filename.c_str(), (int)events.size());
+    events.clear();
+}
+
+int TraceRecorder::threadIndex() {
+    // Called with the mutex locked
+    const auto id = std::this_thread::get_id();
+    const auto it = threadIds.find(id);
+    if (it != threadIds.end()) {
+        return it->second;
+    }
+
+    const int index = (int)threadNames.size();
+    threadIds[id] = index;
+    threadNames.push_back(index == 0 ? "main" : "worker " + std::to_string(index));
+    return index;
+}
+
+void TraceRecorder::setThreadName(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    threadNames[threadIndex()] = name;
+}
+
+void TraceRecorder::addCpuEvent(const std::string &name, double start, double duration) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (recording) {
+        events.push_back({ name, 'X', CPU_PID, threadIndex(), start, duration });
+    }
+}
+
+void TraceRecorder::addGpuEvent(const std::string &name, double start, double duration) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (recording) {
+        events.push_back({ name, 'X', GPU_PID, 0, start, duration });
+    }
+}
+
+void TraceRecorder::addFrameMarker(int frame, double time) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (recording) {
+        events.push_back({ "frame " + std::to_string(frame), 'i', CPU_PID, threadIndex(), time, 0.0 });
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Recorder of Chrome trace events ("trace_event" JSON format, readable by
+ * chrome://tracing and Perfetto). CPU events are put on the track of the
+ * thread which recorded them, and GPU events on a separate process track.
+ * Times are in milliseconds from the profiler epoch.
+ */
+class TraceRecorder {
+public:
+    static TraceRecorder &instance();
+
+    void start(const std::string &filename);
+    void stop();
+
+    void setThreadName(const std::string &name);
+    void addCpuEvent(const std::string &name, double start, double duration);
+    void addGpuEvent(const std::string &name, double start, double duration);
+    void addFrameMarker(int frame, double time);
+
+    bool isRecording() const {
+        return recording;
+    }
+
+private:
+    struct Event {
+        std::string name;
+        char phase;
+        int pid, tid;
+        double start, duration;
+    };
+
+    TraceRecorder() {}
+    int threadIndex();
+
+    bool recording = false;
+    std::string filename;
+    std::mutex mutex;
+    std::vector<Event> events;
+    std::unordered_map<std::thread::id, int> threadIds;
+    std::vector<std::string> threadNames;
+};
@@ -0,0 +1,46 @@
+#include "uniform_buffer.h"
+
+UniformBuffer::UniformBuffer(size_t size, int drawsPerFrame)
+    : size_(size)
+    , numSlots(FramePacer::MAX_FRAMES_IN_FLIGHT * std::max(drawsPerFrame, 1)) {
+    initialize();
+}
+
+UniformBuffer::~UniformBuffer() {
+}
+
+void UniformBuffer::bind(int binding) {
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, bufId, (GLintptr)(slotStride * currentSlot), (GLsizeiptr)size_);
+}
+
+void UniformBuffer::release(int binding) {
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, 0);
+}
+
+void UniformBuffer::initialize() {
+    // Offsets of bound ranges must be multiples of the alignment
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment = std::max(alignment, 1);
+    slotStride = (size_ + alignment - 1) / alignment * alignment;
+
+    glGenBuffers(1, &bufId);
+    glBindBuffer(GL_UNIFORM_BUFFER, bufId);
+    glBufferData(GL_UNIFORM_BUFFER, slotStride * numSlots, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::setData(const void *data) {
+    currentSlot = (currentSlot + 1) % numSlots;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, bufId);
+    glBufferSubData(GL_UNIFORM_BUFFER, (GLintptr)(slotStride * currentSlot), size_, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::destroy() {
+    if (bufId != 0u) {
+        glDeleteBuffers(1, &bufId);
+        bufId = 0u;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "core/common.h"
+#include "core/frame_pacer.h"
+
+/**
+ * Uniform buffer (std140 block) updated with a single buffer write per draw.
+ * Each "setData" writes the next slot of a ring with a slot for every draw of the
+ * frames in flight, so that the update does not wait for draws which still read
+ * the previous contents.
+ */
+class UniformBuffer {
+public:
+    UniformBuffer(size_t size, int drawsPerFrame = 1);
+    virtual ~UniformBuffer();
+
+    void bind(int binding = 0);
+    void release(int binding = 0);
+    void setData(const void *data);
+    void destroy();
+
+    size_t size() const { return size_; }
+
+private:
+    void initialize();
+
+    GLuint bufId = 0u;
+    size_t size_;
+    size_t slotStride = 0;
+    int numSlots;
+    int currentSlot = 0;
+};
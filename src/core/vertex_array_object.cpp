@@ -1,48 +1,166 @@
 #include "vertex_array_object.h"
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
 #include <vector>
-#include <unordered_map>
+#include <unordered_set>
+#include <experimental/filesystem>
 #include <tiny_obj_loader.h>
 
-struct Vertex {
-    Vertex()
-        : position(0.0f, 0.0f, 0.0f)
-        , texcoord(0.0f, 0.0f)
-        , normal(0.0f, 0.0f, 0.0f) {
-    }
+#include "mesh_optimizer.h"
+
+#if defined(_WIN32) || defined(__WIN32__)
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::experimental::filesystem;
+
+namespace {
+
+// Binary mesh cache: header, interleaved vertices and indices
+static const char MESH_CACHE_MAGIC[8] = { 'L', 'P', 'A', 'L', 'M', 'E', 'S', 'H' };
+static const uint32_t MESH_CACHE_VERSION = 2;
+
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint64_t sourceSize;    // size and modification time of the OBJ file
+    int64_t sourceTime;
+    uint64_t numVertices;
+    uint64_t numIndices;
+    float positionOffset[3];
+    float positionScale[3];
+};
 
-	Vertex(const glm::vec3 &position, const glm::vec2 &texcoord, const glm::vec3 &normal)
-        : position(position)
-        , texcoord(texcoord) 
-        , normal(normal) {
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must match the layout in \"vertex_format.glsl\"!");
+
+//! Read-only view of a whole file (memory mapped where available)
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &filename) {
+#if defined(_WIN32) || defined(__WIN32__)
+        std::ifstream reader(filename.c_str(), std::ios::in | std::ios::binary);
+        if (!reader.fail()) {
+            buffer.assign(std::istreambuf_iterator<char>(reader), std::istreambuf_iterator<char>());
+            data_ = (const uint8_t *)buffer.data();
+            size_ = buffer.size();
+            open = true;
+        }
+#else
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                data_ = (const uint8_t *)ptr;
+                size_ = (size_t)st.st_size;
+                open = true;
+            }
+        }
+        ::close(fd);
+#endif
     }
 
-    bool operator==(const Vertex& other) const {
-        if (position != other.position) return false;
-        if (texcoord != other.texcoord) return false;
-        if (normal != other.normal) return false;
-        return true;
+    ~MappedFile() {
+#if !defined(_WIN32) && !defined(__WIN32__)
+        if (open) {
+            munmap((void *)data_, size_);
+        }
+#endif
     }
 
-	glm::vec3 position;
-	glm::vec2 texcoord;
-	glm::vec3 normal;
+    bool isOpen() const { return open; }
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+    bool open = false;
+#if defined(_WIN32) || defined(__WIN32__)
+    std::string buffer;
+#endif
 };
 
-namespace std {
+bool fileStamp(const std::string &filename, uint64_t *size, int64_t *time) {
+    std::error_code ec;
+    const fs::path path(filename);
+    *size = (uint64_t)fs::file_size(path, ec);
+    if (ec) {
+        return false;
+    }
+    *time = (int64_t)fs::last_write_time(path, ec).time_since_epoch().count();
+    return !ec;
+}
+
+// Finalizer of MurmurHash3 (all bits of the input affect all bits of the output)
+uint64_t mixHash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t hashVertex(const Vertex &v) {
+    // "+ 0.0f" turns -0.0 into 0.0, which compare equal
+    const float values[8] = {
+        v.position.x + 0.0f, v.position.y + 0.0f, v.position.z + 0.0f,
+        v.texcoord.x + 0.0f, v.texcoord.y + 0.0f,
+        v.normal.x + 0.0f, v.normal.y + 0.0f, v.normal.z + 0.0f
+    };
 
-template <>
-struct hash<Vertex> {
-    size_t operator()(const Vertex &v) const {
-        size_t h = 0;
-        h = hash<glm::vec3>()(v.position) ^ (h << 1);
-        h = hash<glm::vec2>()(v.texcoord) ^ (h << 1);
-        h = hash<glm::vec3>()(v.normal) ^ (h << 1);
-        return h;
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    for (float value : values) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(uint32_t));
+        h = mixHash(h ^ bits);
     }
-};
+    return h;
+}
+
+// Octahedral mapping of a unit vector to [-1, 1]^2 (the lower hemisphere is folded over the diagonals)
+glm::vec2 encodeOctahedral(const glm::vec3 &n) {
+    const float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (sum == 0.0f) {
+        return glm::vec2(0.0f);
+    }
+
+    glm::vec2 e = glm::vec2(n.x, n.y) / sum;
+    if (n.z < 0.0f) {
+        e = glm::vec2((1.0f - std::abs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f),
+                      (1.0f - std::abs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    return e;
+}
 
-}  // namespace std
+// Splits [0, count) into one contiguous range per thread
+void parallelFor(size_t count, int numThreads, const std::function<void(size_t, size_t)> &func) {
+    numThreads = (int)std::max((size_t)1, std::min((size_t)numThreads, count));
+    std::vector<std::thread> workers;
+    for (int t = 1; t < numThreads; t++) {
+        workers.emplace_back(func, count * t / numThreads, count * (t + 1) / numThreads);
+    }
+    func(0, count / numThreads);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+}  // anonymous namespace
 
 VertexArrayObject::VertexArrayObject() {
 }
@@ -70,6 +188,26 @@ void VertexArrayObject::draw(GLenum mode) {
 }
 
 void VertexArrayObject::addMeshFromFile(const std::string& filename) {
+    setMesh(MeshData::load(filename));
+}
+
+MeshData MeshData::load(const std::string &filename) {
+    // Binary cache next to the OBJ file, which is rebuilt when the OBJ file changes
+    const std::string cacheFile = binaryPath(filename);
+    MeshData mesh;
+    if (loadBinary(cacheFile, mesh, filename)) {
+        return mesh;
+    }
+
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    loadObj(filename, vertices, indices);
+    mesh = build(std::move(vertices), std::move(indices));
+    mesh.saveBinary(cacheFile, filename);
+    return mesh;
+}
+
+void MeshData::loadObj(const std::string &filename, std::vector<Vertex> &vertices, std::vector<uint32_t> &indices, int numThreads) {
     // Load OBJ file.
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
@@ -85,12 +223,25 @@ void VertexArrayObject::addMeshFromFile(const std::string& filename) {
         exit(1);
     }
 
-    std::unordered_map<Vertex, uint32_t> uniqueVertices;
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
-    for (const auto &s: shapes) {
+    if (numThreads <= 0) {
+        numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+
+    // Vertex of every triangle corner
+    std::vector<const tinyobj::index_t *> cornerIndices;
+    for (const auto &s : shapes) {
         for (const auto &index : s.mesh.indices) {
-            Vertex vertex;
+            cornerIndices.push_back(&index);
+        }
+    }
+
+    const size_t numCorners = cornerIndices.size();
+    std::vector<Vertex> corners(numCorners);
+    std::vector<uint64_t> hashes(numCorners);
+    parallelFor(numCorners, numThreads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const auto &index = *cornerIndices[i];
+            Vertex &vertex = corners[i];
             if (index.vertex_index >= 0) {
                 vertex.position = glm::vec3(
                     attrib.vertices[index.vertex_index * 3 + 0],
@@ -114,30 +265,236 @@ void VertexArrayObject::addMeshFromFile(const std::string& filename) {
                 );
             }
 
-            if (uniqueVertices.count(vertex) == 0) {
-                uniqueVertices[vertex] = vertices.size();
-                vertices.push_back(vertex);
+            hashes[i] = hashVertex(vertex);
+        }
+    });
+
+    /*
+     * Deduplication: each worker owns the corners whose hash falls into its shard, and
+     * finds the first corner with the same vertex. Renumbering the first occurrences in
+     * order then gives the same vertex order as a serial pass over the corners.
+     */
+    std::vector<uint32_t> firstCorner(numCorners);
+    parallelFor(numThreads, numThreads, [&](size_t shard, size_t) {
+        const auto hasher = [&](uint32_t i) { return (size_t)hashes[i]; };
+        const auto equal = [&](uint32_t i, uint32_t j) { return corners[i] == corners[j]; };
+        std::unordered_set<uint32_t, decltype(hasher), decltype(equal)> uniqueCorners(numCorners / numThreads + 1, hasher, equal);
+        for (size_t i = 0; i < numCorners; i++) {
+            if ((hashes[i] >> 32) % numThreads == shard) {
+                firstCorner[i] = *uniqueCorners.insert((uint32_t)i).first;
             }
-            indices.push_back(uniqueVertices[vertex]);
         }
+    });
+
+    std::vector<uint32_t> vertexIds(numCorners);
+    vertices.clear();
+    indices.resize(numCorners);
+    for (size_t i = 0; i < numCorners; i++) {
+        if (firstCorner[i] == i) {
+            vertexIds[i] = (uint32_t)vertices.size();
+            vertices.push_back(corners[i]);
+        }
+        indices[i] = vertexIds[firstCorner[i]];
+    }
+}
+
+MeshData MeshData::build(std::vector<Vertex> vertices, std::vector<uint32_t> indices) {
+    // Post-transform cache first, then overdraw within the cache-friendly clusters
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices);
+    optimizeVertexFetch(vertices, indices);
+
+    MeshData mesh;
+    if (!vertices.empty()) {
+        glm::vec3 boundsMin = vertices[0].position;
+        glm::vec3 boundsMax = vertices[0].position;
+        for (const auto &vertex : vertices) {
+            boundsMin = glm::min(boundsMin, vertex.position);
+            boundsMax = glm::max(boundsMax, vertex.position);
+        }
+        mesh.positionOffset = boundsMin;
+        mesh.positionScale = boundsMax - boundsMin;
+    }
+
+    mesh.vertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        mesh.vertices[i] = PackedVertex::pack(vertices[i], mesh.positionOffset, mesh.positionScale);
+    }
+    mesh.indices = std::move(indices);
+    return mesh;
+}
+
+PackedVertex PackedVertex::pack(const Vertex &vertex, const glm::vec3 &positionOffset, const glm::vec3 &positionScale) {
+    PackedVertex packed;
+    for (int i = 0; i < 3; i++) {
+        const float t = positionScale[i] > 0.0f ? (vertex.position[i] - positionOffset[i]) / positionScale[i] : 0.0f;
+        packed.position[i] = (uint16_t)std::round(glm::clamp(t, 0.0f, 1.0f) * 65535.0f);
+    }
+    packed.position[3] = 0;
+
+    // Same bit layouts as unpackHalf2x16 / unpackSnorm2x16 in GLSL
+    packed.texcoord = glm::packHalf2x16(vertex.texcoord);
+    packed.normal = glm::packSnorm2x16(encodeOctahedral(vertex.normal));
+    return packed;
+}
+
+bool MeshData::loadBinary(const std::string &filename, MeshData &mesh, const std::string &sourceFile) {
+    MappedFile file(filename);
+    if (!file.isOpen() || file.size() < sizeof(MeshCacheHeader)) {
+        return false;
+    }
+
+    MeshCacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(MeshCacheHeader));
+    if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != MESH_CACHE_VERSION || header.vertexSize != sizeof(PackedVertex)) {
+        return false;
+    }
+
+    if (!sourceFile.empty()) {
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        if (!fileStamp(sourceFile, &sourceSize, &sourceTime) || header.sourceSize != sourceSize || header.sourceTime != sourceTime) {
+            return false;
+        }
+    }
+
+    const size_t vertexBytes = sizeof(PackedVertex) * header.numVertices;
+    const size_t indexBytes = sizeof(uint32_t) * header.numIndices;
+    if (file.size() != sizeof(MeshCacheHeader) + vertexBytes + indexBytes) {
+        return false;
+    }
+
+    // Vertices and indices are stored as they are uploaded
+    const uint8_t *ptr = file.data() + sizeof(MeshCacheHeader);
+    mesh.vertices.resize(header.numVertices);
+    std::memcpy(mesh.vertices.data(), ptr, vertexBytes);
+    mesh.indices.resize(header.numIndices);
+    std::memcpy(mesh.indices.data(), ptr + vertexBytes, indexBytes);
+    mesh.positionOffset = glm::vec3(header.positionOffset[0], header.positionOffset[1], header.positionOffset[2]);
+    mesh.positionScale = glm::vec3(header.positionScale[0], header.positionScale[1], header.positionScale[2]);
+    return true;
+}
+
+void MeshData::saveBinary(const std::string &filename, const std::string &sourceFile) const {
+    MeshCacheHeader header;
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = sizeof(PackedVertex);
+    header.sourceSize = 0;
+    header.sourceTime = 0;
+    if (!sourceFile.empty()) {
+        fileStamp(sourceFile, &header.sourceSize, &header.sourceTime);
+    }
+    header.numVertices = vertices.size();
+    header.numIndices = indices.size();
+    for (int i = 0; i < 3; i++) {
+        header.positionOffset[i] = positionOffset[i];
+        header.positionScale[i] = positionScale[i];
+    }
+
+    // Written to a temporary file first, so that a concurrent load never sees a partial file
+    const std::string tempFile = filename + ".tmp";
+    {
+        std::ofstream writer(tempFile.c_str(), std::ios::out | std::ios::binary);
+        if (writer.fail()) {
+            // Not fatal (e.g., read-only folder), the OBJ file is parsed again next time
+            fprintf(stderr, "Failed to write mesh cache: %s\n", filename.c_str());
+            return;
+        }
+        writer.write((const char *)&header, sizeof(MeshCacheHeader));
+        writer.write((const char *)vertices.data(), sizeof(PackedVertex) * vertices.size());
+        writer.write((const char *)indices.data(), sizeof(uint32_t) * indices.size());
+    }
+
+    std::error_code ec;
+    fs::rename(fs::path(tempFile), fs::path(filename), ec);
+    if (ec) {
+        fprintf(stderr, "Failed to write mesh cache: %s\n", filename.c_str());
+        fs::remove(fs::path(tempFile), ec);
+    }
+}
+
+void VertexArrayObject::setMesh(const MeshData &mesh) {
+    setMeshes(&mesh, 1);
+}
+
+void VertexArrayObject::setMeshes(const MeshData *meshes, size_t count) {
+    // Layout of the meshes in the shared buffers
+    ranges.assign(count, MeshRange());
+    size_t numIndices = 0;
+    size_t numVertices = 0;
+    for (size_t i = 0; i < count; i++) {
+        ranges[i].firstIndex = numIndices;
+        ranges[i].indexCount = meshes[i].indices.size();
+        ranges[i].baseVertex = numVertices;
+        ranges[i].vertexCount = meshes[i].vertices.size();
+        ranges[i].positionOffset = meshes[i].positionOffset;
+        ranges[i].positionScale = meshes[i].positionScale;
+        numIndices += meshes[i].indices.size();
+        numVertices += meshes[i].vertices.size();
     }
 
     // Prepare VAO.
     glBindVertexArray(vaoId);
 
     glBindBuffer(GL_ARRAY_BUFFER, vboId);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(PackedVertex) * numVertices, nullptr, GL_STATIC_DRAW);
+    for (size_t i = 0; i < count; i++) {
+        const auto &vertices = meshes[i].vertices;
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(PackedVertex) * ranges[i].baseVertex, sizeof(PackedVertex) * vertices.size(), vertices.data());
+    }
 
+    // Quantized attributes, which are decoded in "vertex_format.glsl"
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texcoord));
+    glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texcoord));
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
 
+    // Indices are local to each mesh (offset by "baseVertex" of the draw)
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iboId);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * indices.size(), indices.data(), GL_STATIC_DRAW);
-    bufferSize = indices.size();
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * numIndices, nullptr, GL_STATIC_DRAW);
+    for (size_t i = 0; i < count; i++) {
+        const auto &indices = meshes[i].indices;
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * ranges[i].firstIndex, sizeof(uint32_t) * indices.size(), indices.data());
+    }
+    bufferSize = numIndices;
+    vertexCount = numVertices;
+
+    glBindVertexArray(0);
+}
+
+void VertexArrayObject::drawIndirect(GLenum mode, GLuint commandBufferId, GLsizei drawCount) {
+    glBindVertexArray(vaoId);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBufferId);
+    glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, (void*)0, drawCount, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void VertexArrayObject::setVertexAttribBuffer(GLuint location, GLuint bufferId, GLint components, GLsizei stride) {
+    // Additional per-vertex attribute stored in a separate buffer
+    glBindVertexArray(vaoId);
+
+    glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, components, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(0);
+}
+
+void VertexArrayObject::setInstanceIdBuffer(GLuint location, GLuint bufferId) {
+    // GLSL 4.50 has no "gl_BaseInstance", but instanced attributes start at "baseInstance"
+    glBindVertexArray(vaoId);
+
+    glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+    glEnableVertexAttribArray(location);
+    glVertexAttribIPointer(location, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+    glVertexAttribDivisor(location, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     glBindVertexArray(0);
 }
@@ -1,9 +1,81 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "core/common.h"
 
+struct Vertex {
+    Vertex()
+        : position(0.0f, 0.0f, 0.0f)
+        , texcoord(0.0f, 0.0f)
+        , normal(0.0f, 0.0f, 0.0f) {
+    }
+
+	Vertex(const glm::vec3 &position, const glm::vec2 &texcoord, const glm::vec3 &normal)
+        : position(position)
+        , texcoord(texcoord) 
+        , normal(normal) {
+    }
+
+    bool operator==(const Vertex& other) const {
+        if (position != other.position) return false;
+        if (texcoord != other.texcoord) return false;
+        if (normal != other.normal) return false;
+        return true;
+    }
+
+	glm::vec3 position;
+	glm::vec2 texcoord;
+	glm::vec3 normal;
+};
+
+//! Quantized vertex of the uploaded meshes (16 bytes instead of the 32 bytes of "Vertex")
+struct PackedVertex {
+    uint16_t position[4];   // unorm16 in the bounding box of the mesh (w: padding)
+    uint32_t texcoord;      // half-float x 2
+    uint32_t normal;        // octahedral encoding, snorm16 x 2
+
+    static PackedVertex pack(const Vertex &vertex, const glm::vec3 &positionOffset, const glm::vec3 &positionScale);
+};
+
+//! Indexed triangle mesh loaded on the CPU (can be loaded on any thread)
+struct MeshData {
+    // OBJ file through the binary cache "<filename>.mesh" (written on the first load)
+    static MeshData load(const std::string &filename);
+
+    // OBJ file parsed and deduplicated with "numThreads" workers (0: all hardware threads)
+    static void loadObj(const std::string &filename, std::vector<Vertex> &vertices, std::vector<uint32_t> &indices, int numThreads = 0);
+
+    // Optimizes the triangle and vertex orders for rendering, and quantizes the vertices
+    static MeshData build(std::vector<Vertex> vertices, std::vector<uint32_t> indices);
+
+    // Binary cache, which is rejected if "sourceFile" changed after it was written
+    static bool loadBinary(const std::string &filename, MeshData &mesh, const std::string &sourceFile = "");
+    void saveBinary(const std::string &filename, const std::string &sourceFile = "") const;
+
+    static std::string binaryPath(const std::string &filename) {
+        return filename + ".mesh";
+    }
+
+    std::vector<PackedVertex> vertices;
+    std::vector<uint32_t> indices;
+
+    // Dequantization of the positions: positionOffset + positionScale * unorm
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+};
+
+//! Part of the shared vertex and index buffers occupied by one of the meshes
+struct MeshRange {
+    GLuint firstIndex = 0;
+    GLuint indexCount = 0;
+    GLuint baseVertex = 0;
+    GLuint vertexCount = 0;
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+};
+
 class VertexArrayObject {
 public:
     VertexArrayObject();
@@ -11,10 +83,28 @@ public:
 
     void create();
     void addMeshFromFile(const std::string &filename);
+    void setMesh(const MeshData &mesh);
     void draw(GLenum mode);
     void destroy();
 
+    // Several meshes concatenated in the same buffers (drawn with "drawIndirect")
+    void setMeshes(const MeshData *meshes, size_t count);
+
+    // "glMultiDrawElementsIndirect" with "drawCount" commands of the buffer "commandBufferId"
+    void drawIndirect(GLenum mode, GLuint commandBufferId, GLsizei drawCount);
+
+    void setVertexAttribBuffer(GLuint location, GLuint bufferId, GLint components, GLsizei stride);
+
+    // Integer attribute advanced once per instance, which passes "baseInstance" of the draw commands
+    void setInstanceIdBuffer(GLuint location, GLuint bufferId);
+
+    GLuint vertexBufferId() const { return vboId; }
+    GLsizei numVertices() const { return vertexCount; }
+    const std::vector<MeshRange> &meshRanges() const { return ranges; }
+
 private:
     GLuint vaoId, vboId, iboId;
     GLsizei bufferSize;
+    GLsizei vertexCount = 0;
+    std::vector<MeshRange> ranges;
 };
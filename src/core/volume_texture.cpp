@@ -1,5 +1,8 @@
 ﻿#include <iostream>
 #include <fstream>
+#include <cstring>
+#include <atomic>
+#include <thread>
 #include <experimental/filesystem>
 
 namespace fs = std::experimental::filesystem;
@@ -7,10 +10,17 @@ namespace fs = std::experimental::filesystem;
 #include "common.h"
 #include "volume_texture.h"
 #include "volume_data.h"
+#include "profiler.h"
 
 static constexpr double eps = 1.0e-8;
 static const double pi = 4.0 * std::atan(1.0);
 
+// Names of the individual dispatches shown by the profiler (scope names must outlive the frame)
+static const char *MIP_SCOPE_NAMES[] = { "mipLevel0", "mipLevel1", "mipLevel2", "mipLevel3", "mipLevel4", "mipLevel5", "mipLevel6", "mipLevel7", "mipLevel8", "mipLevel9", "mipLevel10" };
+static const char *GAUSS_SCOPE_NAMES[] = { "gaussLevel0", "gaussLevel1", "gaussLevel2", "gaussLevel3", "gaussLevel4", "gaussLevel5", "gaussLevel6", "gaussLevel7", "gaussLevel8", "gaussLevel9", "gaussLevel10" };
+static const char *SAT_SCOPE_NAMES[] = { "satScanX", "satScanY", "satScanZ" };
+static constexpr int NUM_LEVEL_SCOPE_NAMES = sizeof(MIP_SCOPE_NAMES) / sizeof(MIP_SCOPE_NAMES[0]);
+
 VolumeTexture::VolumeTexture(const glm::ivec3 &innerTexSize, const glm::ivec3 &marginSize, const std::array<glm::vec3, 8> &innerCube, const std::array<glm::vec3, 8> &marginCube)
     : innerTexSize_{ innerTexSize }
     , marginSize_{ marginSize }
@@ -38,6 +48,21 @@ void VolumeTexture::initialize() {
     gaussFilterProgram->addShaderFromFile("shaders/gaussianFilter.comp", ShaderType::Compute);
     gaussFilterProgram->link();
 
+    bakeIrradianceProgram = std::make_shared<ShaderProgram>();
+    bakeIrradianceProgram->create();
+    bakeIrradianceProgram->addShaderFromFile("shaders/bakeIrradiance.comp", ShaderType::Compute);
+    bakeIrradianceProgram->link();
+
+    satMeanProgram = std::make_shared<ShaderProgram>();
+    satMeanProgram->create();
+    satMeanProgram->addShaderFromFile("shaders/satMean.comp", ShaderType::Compute);
+    satMeanProgram->link();
+
+    satScanProgram = std::make_shared<ShaderProgram>();
+    satScanProgram->create();
+    satScanProgram->addShaderFromFile("shaders/satScan.comp", ShaderType::Compute);
+    satScanProgram->link();
+
     // Allocate 3D textures
     const glm::ivec3 extSize = marginedTexSize();
     const int mipLevels = maxLod();
@@ -122,6 +147,50 @@ void VolumeTexture::initialize() {
         glBindTexture(GL_TEXTURE_3D, 0);
     }
 
+    // Summed-area table (zero outside the volume, so that box lookups can be clamped by the border)
+    {
+        glGenTextures(1, &satTexId);
+        glBindTexture(GL_TEXTURE_3D, satTexId);
+        glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA32F, extSize.x, extSize.y, extSize.z);
+
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
+
+        glBindTexture(GL_TEXTURE_3D, 0);
+    }
+
+    // Irradiance probes for diffuse indirect illumination
+    {
+        // Probe grid is an axis-aligned box around the volume
+        glm::vec3 bboxMin = marginedCube_.corners[0];
+        glm::vec3 bboxMax = marginedCube_.corners[0];
+        for (const auto &v : marginedCube_.corners) {
+            bboxMin = glm::min(bboxMin, v);
+            bboxMax = glm::max(bboxMax, v);
+        }
+        const glm::vec3 center = 0.5f * (bboxMin + bboxMax);
+        const glm::vec3 halfExtent = 0.5f * probeGridScale * (bboxMax - bboxMin);
+        probeBoundsMin_ = center - halfExtent;
+        probeBoundsMax_ = center + halfExtent;
+
+        glGenTextures(3, probeTexIds);
+        for (int axis = 0; axis < 3; axis++) {
+            glBindTexture(GL_TEXTURE_3D, probeTexIds[axis]);
+            glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA32F, probeGridSize_.x, probeGridSize_.y, probeGridSize_.z);
+
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_3D, 0);
+    }
 
     // Precompute Gaussian filter kenel
     {
@@ -172,9 +241,32 @@ void VolumeTexture::destroy() {
         glDeleteTextures(1, &filterBufferId);
         filterBufferId = 0;
     }
+
+    if (satTexId != 0) {
+        glDeleteTextures(1, &satTexId);
+        satTexId = 0;
+    }
+
+    if (probeTexIds[0] != 0) {
+        glDeleteTextures(3, probeTexIds);
+        probeTexIds[0] = probeTexIds[1] = probeTexIds[2] = 0;
+    }
+
+    for (int i = 0; i < UPLOAD_RING_SIZE; i++) {
+        if (uploadFences[i] != 0) {
+            glDeleteSync(uploadFences[i]);
+            uploadFences[i] = 0;
+        }
+    }
+
+    if (uploadBufferIds[0] != 0) {
+        glDeleteBuffers(UPLOAD_RING_SIZE, uploadBufferIds);
+        uploadBufferIds[0] = uploadBufferIds[1] = uploadBufferIds[2] = 0;
+    }
 }
 
 void VolumeTexture::readVolumeData(const std::string &folder, const std::string &densityPrefix, const std::string &emissionPrefix) {
+    PROFILE_SCOPE("loadVolume");
     const bool hasEmission = emissionPrefix != "";
 
     std::vector<std::string> densityFiles;
@@ -200,55 +292,69 @@ void VolumeTexture::readVolumeData(const std::string &folder, const std::string
         emissionDataArray.resize(numFrames_);
     }
 
-    const glm::ivec3 extSize = marginedTexSize();
-    for (int i = 0; i < numFrames_; i++) {
-        VolumeData densityData, emissionData;
-        densityData.load(densityFiles[i]);
-        if (hasEmission) {
-            emissionData.load(emissionFiles[i]);
-        }
+    // Frames are independent, so they are read and converted by several workers
+    std::atomic<int> nextIndex(0), numLoaded(0);
+    const auto loadFrames = [&]() {
+        const glm::ivec3 extSize = marginedTexSize();
+        for (int i = nextIndex++; i < numFrames_; i = nextIndex++) {
+            PROFILE_SCOPE("loadVolumeFrame");
+            VolumeData densityData, emissionData;
+            densityData.load(densityFiles[i]);
+            if (hasEmission) {
+                emissionData.load(emissionFiles[i]);
+            }
 
-        densityDataArray[i].resize(extSize.x, extSize.y, extSize.z, 1);
-        emissionDataArray[i].resize(extSize.x, extSize.y, extSize.z, 3);
+            densityDataArray[i].resize(extSize.x, extSize.y, extSize.z, 1);
+            emissionDataArray[i].resize(extSize.x, extSize.y, extSize.z, 3);
 
-        const glm::ivec3 extSize = marginedTexSize();
-        float *densityPtr = densityData.ptr();
-        float *emissionPtr = nullptr;
-        if (hasEmission) {
-            emissionPtr = emissionData.ptr();
-        }
+            float *densityPtr = densityData.ptr();
+            float *emissionPtr = nullptr;
+            if (hasEmission) {
+                emissionPtr = emissionData.ptr();
+            }
 
-        for (int z = 0; z < extSize.z; z++) {
-            for (int y = 0; y < extSize.y; y++) {
-                for (int x = 0; x < extSize.x; x++) {
-                    const int index = (z * extSize.y + y) * extSize.x + x;
-                    if ((x < marginSize_.x || x >= innerTexSize_.x + marginSize_.x) || 
-                        (y < marginSize_.y || y >= innerTexSize_.y + marginSize_.y) ||
-                        (z < marginSize_.z || z >= innerTexSize_.z + marginSize_.z)) {
-                        densityDataArray[i](x, y, z, 0) = 0.0f;
-                        emissionDataArray[i](x, y, z, 0) = 0.0f;
-                        emissionDataArray[i](x, y, z, 1) = 0.0f;
-                        emissionDataArray[i](x, y, z, 2) = 0.0f;
-                    } else {
-                        densityDataArray[i](x, y, z, 0) = (*densityPtr) * densityScale_;
-                        ++densityPtr;
-
-                        if (hasEmission) {
-                            emissionDataArray[i](x, y, z, 0) = *emissionPtr;
-                            emissionDataArray[i](x, y, z, 1) = *emissionPtr;
-                            emissionDataArray[i](x, y, z, 2) = *emissionPtr;
-                            ++emissionPtr;
-                        } else {
+            for (int z = 0; z < extSize.z; z++) {
+                for (int y = 0; y < extSize.y; y++) {
+                    for (int x = 0; x < extSize.x; x++) {
+                        const int index = (z * extSize.y + y) * extSize.x + x;
+                        if ((x < marginSize_.x || x >= innerTexSize_.x + marginSize_.x) || 
+                            (y < marginSize_.y || y >= innerTexSize_.y + marginSize_.y) ||
+                            (z < marginSize_.z || z >= innerTexSize_.z + marginSize_.z)) {
+                            densityDataArray[i](x, y, z, 0) = 0.0f;
                             emissionDataArray[i](x, y, z, 0) = 0.0f;
                             emissionDataArray[i](x, y, z, 1) = 0.0f;
                             emissionDataArray[i](x, y, z, 2) = 0.0f;
+                        } else {
+                            densityDataArray[i](x, y, z, 0) = (*densityPtr) * densityScale_;
+                            ++densityPtr;
+
+                            if (hasEmission) {
+                                emissionDataArray[i](x, y, z, 0) = *emissionPtr;
+                                emissionDataArray[i](x, y, z, 1) = *emissionPtr;
+                                emissionDataArray[i](x, y, z, 2) = *emissionPtr;
+                                ++emissionPtr;
+                            } else {
+                                emissionDataArray[i](x, y, z, 0) = 0.0f;
+                                emissionDataArray[i](x, y, z, 1) = 0.0f;
+                                emissionDataArray[i](x, y, z, 2) = 0.0f;
+                            }
                         }
                     }
                 }
             }
+
+            printf("\r[ %d / %d ] volumes loaded...", ++numLoaded, numFrames_);
         }
+    };
 
-        printf("\r[ %d / %d ] volumes loaded...", i + 1, numFrames_);
+    const int numWorkers = std::max(1, std::min(numFrames_, (int)std::thread::hardware_concurrency()));
+    std::vector<std::thread> workers;
+    for (int w = 1; w < numWorkers; w++) {
+        workers.emplace_back(loadFrames);
+    }
+    loadFrames();
+    for (auto &worker : workers) {
+        worker.join();
     }
     printf("\nOK!\n");
 
@@ -257,21 +363,22 @@ void VolumeTexture::readVolumeData(const std::string &folder, const std::string
 }
 
 void VolumeTexture::updateVolume(const glm::vec3 &lightPos, const glm::vec3 &lightLe) {
-    const glm::ivec3 extSize = marginedTexSize();
+    injectRadiance(lightPos, lightLe);
+    generateMipmaps();
+    nextFrame();
+}
 
-    glBindTexture(GL_TEXTURE_3D, densityTexId);
-    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, extSize.x, extSize.y, extSize.z, GL_RED, GL_FLOAT, densityDataArray[frame].ptr());
-    glBindTexture(GL_TEXTURE_3D, 0);
+void VolumeTexture::injectRadiance(const glm::vec3 &lightPos, const glm::vec3 &lightLe) {
+    PROFILE_SCOPE("inject");
 
-    glBindTexture(GL_TEXTURE_3D, emissionTexId);    
-    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, extSize.x, extSize.y, extSize.z, GL_RGB, GL_FLOAT, emissionDataArray[frame].ptr());
-    glBindTexture(GL_TEXTURE_3D, 0);
+    uploadVolumeData();
 
     static const int localSize = 4;
 
     // Calculate incident radiant intensity to each voxel
     injectRadianceProgram->bind();
     {
+        PROFILE_SCOPE("injectDispatch");
         glBindImageTexture(0, densityTexId, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
         glBindImageTexture(1, radDensTexId, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
 
@@ -299,13 +406,85 @@ void VolumeTexture::updateVolume(const glm::vec3 &lightPos, const glm::vec3 &lig
         glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
     }
     injectRadianceProgram->release();
+}
+
+void VolumeTexture::uploadVolumeData() {
+    PROFILE_SCOPE("upload");
+    const glm::ivec3 extSize = marginedTexSize();
+    const size_t densityBytes = sizeof(float) * extSize.x * extSize.y * extSize.z;
+    const size_t emissionBytes = 3 * densityBytes;
+
+    if (uploadBufferIds[0] == 0) {
+        glGenBuffers(UPLOAD_RING_SIZE, uploadBufferIds);
+        for (int i = 0; i < UPLOAD_RING_SIZE; i++) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBufferIds[i]);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, densityBytes + emissionBytes, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
 
+    // The staging buffer was last used UPLOAD_RING_SIZE uploads before, so this rarely waits
+    const int slot = uploadIndex++ % UPLOAD_RING_SIZE;
+    if (uploadFences[slot] != 0) {
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (true) {
+            const GLenum status = glClientWaitSync(uploadFences[slot], flags, 1000000);  // 1 [ms]
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                break;
+            }
+            if (status == GL_WAIT_FAILED) {
+                FatalError("VolumeTexture: glClientWaitSync failed!");
+            }
+            flags = 0;
+        }
+        glDeleteSync(uploadFences[slot]);
+        uploadFences[slot] = 0;
+    }
+
+    // Copy to the staging buffer without implicit synchronization (guarded by the fence above)
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBufferIds[slot]);
+    char *ptr = (char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, densityBytes + emissionBytes,
+                                         GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    if (ptr == nullptr) {
+        FatalError("Failed to map the staging buffer of volume upload!");
+    }
+    std::memcpy(ptr, densityDataArray[frame].ptr(), densityBytes);
+    if (!emissionDataArray.empty()) {
+        std::memcpy(ptr + densityBytes, emissionDataArray[frame].ptr(), emissionBytes);
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // Transfer to the textures from the staging buffer
+    glBindTexture(GL_TEXTURE_3D, densityTexId);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, extSize.x, extSize.y, extSize.z, GL_RED, GL_FLOAT, (void *)0);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    if (!emissionDataArray.empty()) {
+        glBindTexture(GL_TEXTURE_3D, emissionTexId);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, extSize.x, extSize.y, extSize.z, GL_RGB, GL_FLOAT, (void *)densityBytes);
+        glBindTexture(GL_TEXTURE_3D, 0);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    uploadFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void VolumeTexture::generateMipmaps() {
+    // The summed-area table is built from the base level only
+    if (filterMode_ == VolumeFilterMode::SummedAreaTable) {
+        return;
+    }
+
+    PROFILE_SCOPE("mip");
     // GPU based MIP mapping
+    static const int localSize = 4;
+
     mipmapProgram->bind();
     {
         const int mipLevels = maxLod();
         glm::ivec3 levelSize = marginedTexSize();
         for (int level = 1; level < mipLevels; level++) {
+            PROFILE_SCOPE(MIP_SCOPE_NAMES[std::min(level, NUM_LEVEL_SCOPE_NAMES - 1)]);
             glBindImageTexture(0, radDensTexId, level - 1, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
             glBindImageTexture(1, radDensTexId, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
 
@@ -319,12 +498,22 @@ void VolumeTexture::updateVolume(const glm::vec3 &lightPos, const glm::vec3 &lig
         }
     }
     mipmapProgram->release();
+}
 
-    // Increment frame
+void VolumeTexture::nextFrame() {
     frame = (frame + 1) % numFrames_;
 }
 
+void VolumeTexture::filterVolume() {
+    if (filterMode_ == VolumeFilterMode::SummedAreaTable) {
+        buildSummedAreaTable();
+    } else {
+        gaussianFilter3D();
+    }
+}
+
 void VolumeTexture::gaussianFilter3D() {
+    PROFILE_SCOPE("gaussian");
     static const int localSize = 4;
 
     gaussFilterProgram->bind();
@@ -338,19 +527,23 @@ void VolumeTexture::gaussianFilter3D() {
             texSizeLod[level] = texSizeLod[level - 1] / 2;
         }
         
+        // Level-invariant parameters are set only once
+        gaussFilterProgram->setUniformValue("u_marginSize", marginSize_);
+        gaussFilterProgram->setUniformValue("u_maxLOD", mipLevels);
+        gaussFilterProgram->setUniformValue("u_kernelSize", (int)(kernelTexBuffer->size() / sizeof(float)));
+        kernelTexBuffer->bind(0);
+        gaussFilterProgram->setUniformValue("u_gaussKernel", 0);
+
+        const auto lodTexSizeUniform = gaussFilterProgram->uniform<glm::ivec3>("u_lodTexSize");
+        const auto lodUniform = gaussFilterProgram->uniform<int>("u_LOD");
         for (int level = mipLevels; level >= 0; level--) {
+            PROFILE_SCOPE(GAUSS_SCOPE_NAMES[std::min(level, NUM_LEVEL_SCOPE_NAMES - 1)]);
             glBindImageTexture(0, radDensTexId, level, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
             glBindImageTexture(1, filteredTexId, level, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
             glBindImageTexture(2, filterBufferId, level, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
 
-            gaussFilterProgram->setUniformValue("u_lodTexSize", texSizeLod[level]);
-            gaussFilterProgram->setUniformValue("u_marginSize", marginSize_);
-            gaussFilterProgram->setUniformValue("u_LOD", level);
-            gaussFilterProgram->setUniformValue("u_maxLOD", mipLevels);
-
-            gaussFilterProgram->setUniformValue("u_kernelSize", (int)(kernelTexBuffer->size() / sizeof(float)));
-            kernelTexBuffer->bind(0);
-            gaussFilterProgram->setUniformValue("u_gaussKernel", 0);
+            lodTexSizeUniform.set(texSizeLod[level]);
+            lodUniform.set(level);
 
             const int numGruopSizeX = (texSizeLod[level].x + localSize - 1) / localSize;
             const int numGruopSizeY = (texSizeLod[level].y + localSize - 1) / localSize;
@@ -362,3 +555,99 @@ void VolumeTexture::gaussianFilter3D() {
     }
     gaussFilterProgram->release();
 }
+
+void VolumeTexture::buildSummedAreaTable() {
+    PROFILE_SCOPE("summedAreaTable");
+    static const int localSize = 8;
+
+    const glm::ivec3 extSize = marginedTexSize();
+
+    // Base level is used as is for point lookups (and by the ray marching)
+    glCopyImageSubData(radDensTexId, GL_TEXTURE_3D, 0, 0, 0, 0,
+                       filteredTexId, GL_TEXTURE_3D, 0, 0, 0, 0,
+                       extSize.x, extSize.y, extSize.z);
+
+    // Mean of the volume (at the top level of the filtered texture, where the lookups read it)
+    const int topLevel = maxLod() - 1;
+    satMeanProgram->bind();
+    {
+        PROFILE_SCOPE("satMean");
+        glBindImageTexture(0, radDensTexId, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
+        glBindImageTexture(1, filteredTexId, topLevel, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        satMeanProgram->setUniformValue("u_texSize", extSize);
+
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+    satMeanProgram->release();
+
+    // Prefix sums along X, Y and Z (the first pass reads the radiant intensity minus the mean)
+    satScanProgram->bind();
+    {
+        satScanProgram->setUniformValue("u_texSize", extSize);
+        glBindImageTexture(2, filteredTexId, topLevel, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
+        for (int axis = 0; axis < 3; axis++) {
+            PROFILE_SCOPE(SAT_SCOPE_NAMES[axis]);
+            const GLuint inputTexId = axis == 0 ? radDensTexId : satTexId;
+            glBindImageTexture(0, inputTexId, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
+            glBindImageTexture(1, satTexId, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+            satScanProgram->setUniformValue("u_axis", axis);
+
+            // Lines are spanned by the two other axes
+            const int lineSizeU = axis == 0 ? extSize.y : extSize.x;
+            const int lineSizeV = axis == 2 ? extSize.y : extSize.z;
+            const int numGroupSizeX = (lineSizeU + localSize - 1) / localSize;
+            const int numGroupSizeY = (lineSizeV + localSize - 1) / localSize;
+
+            glDispatchCompute(numGroupSizeX, numGroupSizeY, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+    }
+    satScanProgram->release();
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void VolumeTexture::bakeIrradianceProbes() {
+    PROFILE_SCOPE("probe");
+    static const int localSize = 4;
+
+    // The filtered texture is read with texture fetches
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    bakeIrradianceProgram->bind();
+    {
+        for (int axis = 0; axis < 3; axis++) {
+            glBindImageTexture(axis, probeTexIds[axis], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        }
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, filteredTexId);
+        bakeIrradianceProgram->setUniformValue("u_filteredTex", 0);
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, satTexId);
+        bakeIrradianceProgram->setUniformValue("u_satTex", 1);
+        bakeIrradianceProgram->setUniformValue("u_useSummedAreaTable", filterMode_ == VolumeFilterMode::SummedAreaTable ? 1 : 0);
+        bakeIrradianceProgram->setUniformValue("u_satFootprintScale", satFootprintScale());
+
+        // Each sample takes the average over the mip level whose texel matches the sample spacing
+        const float sampleLod = std::log2((float)maxExtentMargined() / (float)probeSampleDivide);
+
+        bakeIrradianceProgram->setUniformValue("u_probeGridSize", probeGridSize_);
+        bakeIrradianceProgram->setUniformValue("u_probeBoundsMin", probeBoundsMin_);
+        bakeIrradianceProgram->setUniformValue("u_probeBoundsMax", probeBoundsMax_);
+        bakeIrradianceProgram->setUniformValue("u_sampleDivide", probeSampleDivide);
+        bakeIrradianceProgram->setUniformValue("u_sampleLOD", std::max(0.0f, sampleLod));
+        bakeIrradianceProgram->setUniformValue("u_maxLOD", maxLod());
+        bakeIrradianceProgram->setUniformValue("u_albedo", albedo_);
+        bakeIrradianceProgram->setUniformValueArray("u_marginCubeVertices", marginedCube_.corners.data(), marginedCube_.corners.size());
+
+        const int numGroupSizeX = (probeGridSize_.x + localSize - 1) / localSize;
+        const int numGroupSizeY = (probeGridSize_.y + localSize - 1) / localSize;
+        const int numGroupSizeZ = (probeGridSize_.z + localSize - 1) / localSize;
+
+        glDispatchCompute(numGroupSizeX, numGroupSizeY, numGroupSizeZ);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+    bakeIrradianceProgram->release();
+}
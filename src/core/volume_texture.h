@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "common.h"
+#include "frame_pacer.h"
 #include "shader_program.h"
 #include "texture_buffer.h"
 #include "volume_data.h"
@@ -13,6 +14,11 @@ enum class VolumeType : uint32_t {
     Emissive = 1
 };
 
+enum class VolumeFilterMode : uint32_t {
+    MipGaussian = 0,     // Gaussian filtered mip chain (LPAL footprints snap to mip levels)
+    SummedAreaTable = 1  // 3D summed-area table (box average for arbitrary footprints)
+};
+
 struct Cube {
     Cube() {}
     Cube(const std::array<glm::vec3, 8>& corners)
@@ -40,7 +46,14 @@ public:
     void initialize();
     void readVolumeData(const std::string &folder, const std::string &densityPrefix, const std::string &emissionPrefix = "");
     void updateVolume(const glm::vec3 &lightPos, const glm::vec3 &lightLe);
+    void injectRadiance(const glm::vec3 &lightPos, const glm::vec3 &lightLe);
+    void generateMipmaps();
+    void nextFrame();
+    void uploadVolumeData();
+    void filterVolume();
     void gaussianFilter3D();
+    void buildSummedAreaTable();
+    void bakeIrradianceProbes();
 
     int totalSizeInner() const {
         return innerTexSize_.x * innerTexSize_.y * innerTexSize_.z;
@@ -88,6 +101,14 @@ public:
         this->type = type;
     }
 
+    VolumeFilterMode filterMode() const {
+        return filterMode_;
+    }
+
+    void setFilterMode(VolumeFilterMode mode) {
+        this->filterMode_ = mode;
+    }
+
     glm::ivec3 innerTexSize() const {
         return innerTexSize_;
     }
@@ -121,6 +142,31 @@ public:
         return numFrames_;
     }
 
+    GLuint getSatTexId() const {
+        return satTexId;
+    }
+
+    float satFootprintScale() const {
+        // Box width whose variance equals that of a Gaussian filtered mip texel (in texels of the level)
+        return std::sqrt(12.0f * sigmaGauss * sigmaGauss + 1.0f);
+    }
+
+    GLuint getProbeTexId(int axis) const {
+        return probeTexIds[axis];
+    }
+
+    glm::ivec3 probeGridSize() const {
+        return probeGridSize_;
+    }
+
+    glm::vec3 probeBoundsMin() const {
+        return probeBoundsMin_;
+    }
+
+    glm::vec3 probeBoundsMax() const {
+        return probeBoundsMax_;
+    }
+
 private:
     glm::ivec3 innerTexSize_;
     glm::ivec3 marginSize_;
@@ -129,6 +175,7 @@ private:
     glm::vec3 emission_ = glm::vec3(1.0f);
     float densityScale_ = 1.0f;
     VolumeType type = VolumeType::Emissive;
+    VolumeFilterMode filterMode_ = VolumeFilterMode::MipGaussian;
 
     Cube innerCube_, marginedCube_;
 
@@ -140,10 +187,26 @@ private:
     GLuint radDensTexId = 0;    // Incident radiant intensity
     GLuint filteredTexId = 0;   // Filtered radiant intensity and volume density (RGB: rad, A: density)
     GLuint filterBufferId = 0;  // Buffer for Gaussian filter
+    GLuint satTexId = 0;        // Summed-area table of radiant intensity and volume density
+    GLuint probeTexIds[3] = { 0, 0, 0 };  // Irradiance vectors of probes along X, Y and Z (RGB: color channels)
+
+    // Staging buffers of volume uploads, multi-buffered for the frames in flight
+    static constexpr int UPLOAD_RING_SIZE = FramePacer::MAX_FRAMES_IN_FLIGHT;
+    GLuint uploadBufferIds[UPLOAD_RING_SIZE] = { 0, 0, 0 };
+    GLsync uploadFences[UPLOAD_RING_SIZE] = { 0, 0, 0 };
+    int uploadIndex = 0;
+
+    const glm::ivec3 probeGridSize_ = glm::ivec3(16, 16, 16);
+    const float probeGridScale = 3.0f;   // Extent of probe grid relative to the volume bounding box
+    const int probeSampleDivide = 8;     // # of volume samples per axis to bake each probe
+    glm::vec3 probeBoundsMin_, probeBoundsMax_;
 
     std::shared_ptr<ShaderProgram> injectRadianceProgram = nullptr;
     std::shared_ptr<ShaderProgram> mipmapProgram = nullptr;
     std::shared_ptr<ShaderProgram> gaussFilterProgram = nullptr;
+    std::shared_ptr<ShaderProgram> bakeIrradianceProgram = nullptr;
+    std::shared_ptr<ShaderProgram> satMeanProgram = nullptr;
+    std::shared_ptr<ShaderProgram> satScanProgram = nullptr;
 
     int numFrames_ = 1;
     int frame = 0;
@@ -0,0 +1,65 @@
+#include "volume_texture_set.h"
+
+#include "profiler.h"
+
+void VolumeTextureSet::add(std::unique_ptr<VolumeTexture> volume, const glm::mat4 &transform) {
+    if ((int)entries.size() >= MAX_VOLUMES) {
+        FatalError("Too many volumes (at most %d)!", MAX_VOLUMES);
+    }
+
+    Entry entry;
+    entry.volume = std::move(volume);
+    entry.transform = transform;
+    entries.push_back(std::move(entry));
+    revision_++;
+}
+
+void VolumeTextureSet::clear() {
+    for (auto &entry : entries) {
+        entry.volume->destroy();
+    }
+    entries.clear();
+}
+
+int VolumeTextureSet::update(const PointLight &light) {
+    int numUpdated = 0;
+    for (auto &entry : entries) {
+        const bool lightChanged = entry.light.pos != light.pos || entry.light.Le != light.Le;
+        if (!entry.dirty && !lightChanged && entry.volume->numFrames() <= 1) {
+            continue;
+        }
+
+        PROFILE_SCOPE("updateVolume");
+        entry.volume->updateVolume(light.pos, light.Le);
+        entry.volume->filterVolume();
+        entry.volume->bakeIrradianceProbes();
+        entry.light = light;
+        entry.dirty = false;
+        numUpdated++;
+        revision_++;
+    }
+    return numUpdated;
+}
+
+void VolumeTextureSet::invalidate() {
+    for (auto &entry : entries) {
+        entry.dirty = true;
+    }
+}
+
+void VolumeTextureSet::markUpdated(const PointLight &light) {
+    for (auto &entry : entries) {
+        entry.light = light;
+        entry.dirty = false;
+    }
+    revision_++;
+}
+
+void VolumeTextureSet::setFilterMode(VolumeFilterMode mode) {
+    for (auto &entry : entries) {
+        if (entry.volume->filterMode() != mode) {
+            entry.volume->setFilterMode(mode);
+            entry.dirty = true;
+        }
+    }
+}
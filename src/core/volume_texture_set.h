@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "common.h"
+#include "point_light.h"
+#include "volume_texture.h"
+
+/**
+ * Emissive volumes of a scene, each placed by its own transformation (from the cube
+ * [-1, 1]^3 to the margined bounds of the volume). The camera-independent work
+ * (upload, injection, mip, filter and probes) runs only for the volumes whose input
+ * changed since their last update: animated volumes every frame, static volumes when
+ * the light or the filter changes.
+ */
+class VolumeTextureSet {
+public:
+    // Upper limit of the volumes shaded together (the LPAL shaders loop over them)
+    static constexpr int MAX_VOLUMES = 4;
+
+    void add(std::unique_ptr<VolumeTexture> volume, const glm::mat4 &transform);
+    void clear();
+
+    // Returns the number of volumes updated
+    int update(const PointLight &light);
+
+    // Incremented whenever the data of a volume changes (an update or a new volume)
+    uint64_t revision() const {
+        return revision_;
+    }
+
+    // The next "update" rebuilds every volume
+    void invalidate();
+
+    // Records that every volume was rebuilt outside "update" (for the given light)
+    void markUpdated(const PointLight &light);
+
+    void setFilterMode(VolumeFilterMode mode);
+
+    VolumeFilterMode filterMode() const {
+        return entries.empty() ? VolumeFilterMode::MipGaussian : entries[0].volume->filterMode();
+    }
+
+    int size() const {
+        return (int)entries.size();
+    }
+
+    bool empty() const {
+        return entries.empty();
+    }
+
+    VolumeTexture &operator[](int index) {
+        return *entries[index].volume;
+    }
+
+    const VolumeTexture &operator[](int index) const {
+        return *entries[index].volume;
+    }
+
+    const glm::mat4 &transform(int index) const {
+        return entries[index].transform;
+    }
+
+private:
+    struct Entry {
+        std::unique_ptr<VolumeTexture> volume;
+        glm::mat4 transform;
+        bool dirty = true;
+        PointLight light;  // light of the last update
+    };
+
+    std::vector<Entry> entries;
+    uint64_t revision_ = 0;
+};
@@ -6,15 +6,28 @@
 #include <iostream>
 #include <algorithm>
 #include <string>
+#include <cctype>
 #include <array>
+#include <functional>
+#include <chrono>
+#include <future>
+#include <thread>
 
 #include "core/common.h"
 #include "core/config.h"
+#include "core/framebuffer.h"
 #include "core/timer.h"
 #include "core/point_light.h"
 #include "core/direct_volume.h"
 #include "core/indirect_surface.h"
-#include "core/volume_texture.h"
+#include "core/volume_texture_set.h"
+#include "core/headless_context.h"
+#include "core/benchmark.h"
+#include "core/profiler.h"
+#include "core/trace.h"
+#include "core/frame_pacer.h"
+#include "core/frame_state.h"
+#include "core/mesh_optimizer.h"
 
 static const int WIN_WIDTH = 960;
 static const int WIN_HEIGHT = 960;
@@ -34,7 +47,29 @@ PointLight pointLight;
 
 std::unique_ptr<DirectVolume> directVolume = nullptr;
 std::unique_ptr<IndirectSurface> indirectSurface = nullptr;
-std::unique_ptr<VolumeTexture> volTex = nullptr;
+VolumeTextureSet volumes;
+std::shared_ptr<Framebuffer> sceneFbo = nullptr;
+
+// Views rendered in each frame, side by side in the scene buffer (one view draws into it directly)
+static constexpr int MAX_VIEWS = IndirectSurface::MAX_VIEWS;
+int numViews = 1;
+std::vector<std::shared_ptr<Framebuffer>> viewFbos;
+FramePacer framePacer;
+FrameState frameState;
+bool rotateCamera = true;
+int cameraFrame = 0;
+
+// Frames rendered after a change while the temporal accumulation of the volume converges
+static constexpr int TEMPORAL_SETTLE_FRAMES = 32;
+
+double startupTime = 0.0;  // [ms] initializeGL including shader compilation and the first volume update
+double timeToFirstFrame = 0.0;  // [ms] process start until the first frame is rendered
+static const auto processStart = std::chrono::high_resolution_clock::now();
+
+// Assets loaded on worker threads from the start (GL objects are created once they are ready)
+std::future<SurfaceScene> sceneFuture;
+std::future<ImageData> roughnessFuture;
+std::future<void> volumeFuture;
 std::unique_ptr<ShaderProgram> gaussianCompShader = nullptr;
 std::unique_ptr<ShaderProgram> radianceCompShader = nullptr;
 std::unique_ptr<ShaderProgram> mipCompShader = nullptr;
@@ -50,12 +85,23 @@ static const std::array<glm::vec3, 8> REGULAR_CUBE = {
     glm::vec3( 1.0f,  1.0f,  1.0f)
 };
 
-void saveCurrentBuffer(GLFWwindow *window, const std::string &filename) {
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
+// Volume transformation (default placement, "volumePos" and "volumeScale" in the config)
+static const glm::vec3 DEFAULT_VOLUME_POS = glm::vec3(0.0f, 4.0f, 0.0f);
+static const float DEFAULT_VOLUME_SCALE = 3.3f;
+static const float volMarginFactor = (float)(INNER_TEX_SIZE + 2 * TEX_MARGIN) / (float)INNER_TEX_SIZE;
+static const glm::mat4 volRotate = glm::rotate(0.0f * PI, glm::vec3(0.0f, 1.0f, 0.0f)) *
+                                   glm::rotate(-0.0f * PI, glm::vec3(0.0f, 0.1f, 1.0f));
 
+void saveSceneBuffer(const std::string &filename) {
+    const int width = sceneFbo->width();
+    const int height = sceneFbo->height();
+
+    // Read back from the scene buffer, so that it also works without a window
     auto bytes = std::make_unique<uint8_t[]>(width * height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFbo->getId());
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
     glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void *)bytes.get());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 
     // Invert vertically
     for (int y = 0; y < height / 2; y++) {
@@ -69,7 +115,7 @@ void saveCurrentBuffer(GLFWwindow *window, const std::string &filename) {
 
     // Save
     stbi_write_png(filename.c_str(), width, height, 4, bytes.get(), 0);
-    printf("Save: %s", filename.c_str());
+    printf("Save: %s\n", filename.c_str());
 }
 
 // ----------------------------------------------------------------------------
@@ -77,8 +123,8 @@ void saveCurrentBuffer(GLFWwindow *window, const std::string &filename) {
 // ----------------------------------------------------------------------------
 
 void updateVolume() {
-    volTex->updateVolume(pointLight.pos, pointLight.Le);
-    volTex->gaussianFilter3D();
+    // Only the animated volumes and those affected by a change of the light
+    volumes.update(pointLight);
 }
 
 void updateCamera(int frame) {
@@ -89,11 +135,157 @@ void updateCamera(int frame) {
     camera.viewMat = glm::lookAt(camera.pos, camera.dir, camera.up);
 }
 
+void updateLight(int frame) {
+    // Move point light on a small circle around its initial position (benchmark)
+    static const float radius = 1.5f;
+    const float theta = 2.0f * PI / 360.0f * frame;
+    pointLight.pos = config.getVec3D("lightPos") + radius * glm::vec3(std::cos(theta), 0.0f, std::sin(theta));
+}
+
 // ----------------------------------------------------------------------------
 // OpenGL and GLFW utilities
 // ----------------------------------------------------------------------------
 
+std::shared_ptr<Framebuffer> createSceneTarget(int width, int height) {
+    // Color and depth, the depth is read by the volume ray marching and the occlusion culling
+    auto fbo = std::make_shared<Framebuffer>();
+    fbo->create(width, height);
+    fbo->addColorAttachment(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+    fbo->addDepthAttachment();
+    return fbo;
+}
+
+void resizeSceneBuffer(int width, int height) {
+    // Offscreen target of the scene
+    if (sceneFbo) {
+        sceneFbo->destroy();
+    }
+    sceneFbo = createSceneTarget(width, height);
+
+    // Targets of the views (the scene buffer itself for a single view)
+    for (const auto &fbo : viewFbos) {
+        if (fbo != sceneFbo) {
+            fbo->destroy();
+        }
+    }
+    viewFbos.clear();
+    const int viewWidth = std::max(width / numViews, 1);
+    for (int i = 0; i < numViews; i++) {
+        viewFbos.push_back(numViews == 1 ? sceneFbo : createSceneTarget(viewWidth, height));
+    }
+
+    // Projection of the views
+    camera.projMat = glm::perspective(glm::radians(45.0f), float(viewWidth) / float(height), 0.1f, 1000.0f);
+}
+
+// ----------------------------------------------------------------------------
+// Startup
+// ----------------------------------------------------------------------------
+
+std::string volumeParameter(const std::string &name, int index) {
+    // Volume 0 is configured by "volumeFolder", the others by "volumeFolder1", "volumeFolder2", ...
+    return index == 0 ? name : name + std::to_string(index);
+}
+
+void createVolumeTextures() {
+    for (int index = 0; index < VolumeTextureSet::MAX_VOLUMES; index++) {
+        if (!config.hasParameter(volumeParameter("volumeFolder", index))) {
+            break;
+        }
+
+        // Placement of the volume (optional parameters)
+        const std::string posName = volumeParameter("volumePos", index);
+        const std::string scaleName = volumeParameter("volumeScale", index);
+        const std::string emissionName = volumeParameter("emission", index);
+        const glm::vec3 pos = config.hasParameter(posName) ? config.getVec3D(posName) : DEFAULT_VOLUME_POS;
+        const float scale = config.hasParameter(scaleName) ? config.getFloat(scaleName) : DEFAULT_VOLUME_SCALE;
+        const glm::mat4 volScale = glm::scale(glm::vec3(scale));
+        const glm::mat4 volMarginScale = glm::scale(glm::vec3(volMarginFactor)) * volScale;
+        const glm::mat4 volTranslate = glm::translate(pos);
+
+        // Calculate bounding box for volume
+        std::array<glm::vec3, 8> innerCube;
+        std::array<glm::vec3, 8> marginedCube;
+        for (int i = 0; i < 8; i++) {
+            // Internal cube without margin
+            glm::vec4 vc = volTranslate * volRotate * volScale * glm::vec4(REGULAR_CUBE[i], 1.0f);
+            innerCube[i] = glm::vec3(vc) / vc.w;
+
+            // External cube with margin
+            glm::vec4 mc = volTranslate * volRotate * volMarginScale * glm::vec4(REGULAR_CUBE[i], 1.0f);
+            marginedCube[i] = glm::vec3(mc) / mc.w;
+        }
+
+        // Volume and its rendering parameters (the data is read by "startAssetLoading")
+        const glm::ivec3 innerTexSize(INNER_TEX_SIZE, INNER_TEX_SIZE, INNER_TEX_SIZE);
+        const glm::ivec3 marginSize(TEX_MARGIN, TEX_MARGIN, TEX_MARGIN);
+
+        auto volTex = std::make_unique<VolumeTexture>(innerTexSize, marginSize, innerCube, marginedCube);
+        volTex->setAlbedo(config.getVec3D("albedo"));
+        volTex->setEmission(config.getVec3D(config.hasParameter(emissionName) ? emissionName : "emission"));
+        volTex->setDensityScale(config.getFloat("densityScale"));
+        volTex->setVolumeType(VolumeType::Emissive);
+        volumes.add(std::move(volTex), volTranslate * volRotate * volMarginScale);
+    }
+
+    if (volumes.empty()) {
+        FatalError("No parameter \"volumeFolder\" found!");
+    }
+}
+
+template <typename Func>
+auto loadAsync(const char *threadName, Func func) -> std::future<decltype(func())> {
+    return std::async(std::launch::async, [threadName, func] {
+        TraceRecorder::instance().setThreadName(threadName);
+        return func();
+    });
+}
+
+void startAssetLoading() {
+    // Only CPU work (file I/O and decoding), so it can start before the GL context exists
+    createVolumeTextures();
+
+    // Scene file with many instances (optional), or a single instance of the mesh file
+    const bool hasSceneFile = config.hasParameter("sceneFile");
+    const std::string surfaceFile = config.getPath(hasSceneFile ? "sceneFile" : "meshFile");
+    const std::string roughTexFile = config.getPath("roughTexFile");
+    std::vector<std::string> volumeFolders;
+    for (int i = 0; i < volumes.size(); i++) {
+        volumeFolders.push_back(config.getPath(volumeParameter("volumeFolder", i)));
+    }
+    sceneFuture = loadAsync("meshLoader", [surfaceFile, hasSceneFile] {
+        PROFILE_SCOPE("loadMesh");
+        return hasSceneFile ? SurfaceScene::load(surfaceFile) : SurfaceScene::fromMesh(MeshData::load(surfaceFile));
+    });
+    roughnessFuture = loadAsync("imageLoader", [roughTexFile] {
+        PROFILE_SCOPE("loadImage");
+        return ImageData::load(roughTexFile);
+    });
+    volumeFuture = loadAsync("volumeLoader", [volumeFolders] {
+        // Each volume reads its frames with several workers
+        for (int i = 0; i < (int)volumeFolders.size(); i++) {
+            volumes[i].readVolumeData(volumeFolders[i], "density", "emission");
+        }
+    });
+}
+
+void reportFirstFrame() {
+    if (timeToFirstFrame > 0.0) {
+        return;
+    }
+
+    glFinish();
+    timeToFirstFrame = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - processStart).count();
+    printf("Time to first frame: %.1f [ms]\n", timeToFirstFrame);
+}
+
 void initializeGL() {
+    const auto startupBegin = std::chrono::high_resolution_clock::now();
+
+    // Render target size (window framebuffer, or the requested size for headless mode)
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
     // OpenGL
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
@@ -108,72 +300,137 @@ void initializeGL() {
     camera.dir = config.getVec3D("cameraDir");
     camera.up = config.getVec3D("cameraUp");
     camera.viewMat = glm::lookAt(camera.pos, camera.dir, camera.up);
-    camera.projMat = glm::perspective(glm::radians(45.0f), float(WIN_WIDTH) / float(WIN_HEIGHT), 0.1f, 1000.0f);
 
     // Light
     pointLight.Le = config.getVec3D("lightLe");
     pointLight.pos = config.getVec3D("lightPos");
 
-    // Scene
+    // Shader programs are submitted first and compiled while the assets are still loading
+    const bool parallelCompile = ShaderProgram::enableParallelCompile();
+    for (int i = 0; i < volumes.size(); i++) {
+        volumes[i].initialize();
+    }
+
+    directVolume = std::make_unique<DirectVolume>();
+    directVolume->initialize();
+
     indirectSurface = std::make_unique<IndirectSurface>();
     indirectSurface->initialize();
-    indirectSurface->setMeshFromFile(config.getPath("meshFile"));
     indirectSurface->setNumSections(config.getInt("numSlices"));
-    indirectSurface->setRoughnessTexure(config.getPath("roughTexFile"));
-
-    // Calculate volume transformation
-    static const glm::mat4 volScale = glm::scale(glm::vec3(3.3f));
-    static const glm::mat4 volMarginScale = glm::scale(glm::vec3((float)(INNER_TEX_SIZE + 2 * TEX_MARGIN) / (float)INNER_TEX_SIZE)) * volScale;
-    static const glm::mat4 volRotate = glm::rotate(0.0f * PI, glm::vec3(0.0f, 1.0f, 0.0f)) *
-                                       glm::rotate(-0.0f * PI, glm::vec3(0.0f, 0.1f, 1.0f));
-    static const glm::mat4 volTranslate = glm::translate(glm::vec3(0.0f, 4.0f, 0.0f));
-
-    // Calculate bounding box for volume
-    std::array<glm::vec3, 8> innerCube;
-    std::array<glm::vec3, 8> marginedCube;
-    for (int i = 0; i < 8; i++) {
-        // Internal cube without margin
-        glm::vec4 vc = volTranslate * volRotate * volScale * glm::vec4(REGULAR_CUBE[i], 1.0f);
-        innerCube[i] = glm::vec3(vc) / vc.w;
-
-        // External cube with margin
-        glm::vec4 mc = volTranslate * volRotate * volMarginScale * glm::vec4(REGULAR_CUBE[i], 1.0f);
-        marginedCube[i] = glm::vec3(mc) / mc.w;
-    }
-
-    // Load volume and set rendering parameters
-    const glm::ivec3 innerTexSize(INNER_TEX_SIZE, INNER_TEX_SIZE, INNER_TEX_SIZE);
-    const glm::ivec3 marginSize(TEX_MARGIN, TEX_MARGIN, TEX_MARGIN);
-
-    volTex = std::make_unique<VolumeTexture>(innerTexSize, marginSize, innerCube, marginedCube);
-    volTex->initialize();
-    volTex->setAlbedo(config.getVec3D("albedo"));
-    volTex->setEmission(config.getVec3D("emission"));
-    volTex->setDensityScale(config.getFloat("densityScale"));
-    volTex->setVolumeType(VolumeType::Emissive);
-    volTex->readVolumeData(config.getPath("volumeFolder"), "density", "emission");
-
-    // volume (for ray marching)
-    directVolume = std::make_unique<DirectVolume>();
-    directVolume->initialize();
-    directVolume->setLocation(volTranslate * volRotate * volMarginScale);
+    if (volumes.size() > indirectSurface->maxVolumes()) {
+        printf("[WARNING] %d volumes are configured, but the texture units of this GPU light the surfaces "
+               "with the first %d only\n", volumes.size(), indirectSurface->maxVolumes());
+    }
+
+    // Scene buffer (and the projection of the camera)
+    resizeSceneBuffer(viewport[2], viewport[3]);
+
+    // GL objects of the assets, once their data is ready
+    const SurfaceScene scene = sceneFuture.get();
+    indirectSurface->setScene(scene);
+    printf("Surfaces: %zu meshes, %zu instances, %zu triangles\n", scene.meshes.size(), scene.instances.size(), scene.numTriangles());
+    indirectSurface->setRoughnessTexure(roughnessFuture.get());
+    volumeFuture.get();
 
     // preparation for drawing the first frame
     updateVolume();
+
+    // Startup time (cold: programs compiled from source, warm: loaded from the binary cache)
+    glFinish();
+    startupTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startupBegin).count();
+
+    const auto &shaderStats = ShaderProgram::cacheStatistics();
+    printf("Startup: %.1f [ms] (programs: %d compiled in %.1f [ms], %d loaded from cache in %.1f [ms], %d compiling in background, parallel compile: %s)\n",
+           startupTime, shaderStats.numCompiled, shaderStats.compileTime, shaderStats.numLoaded, shaderStats.loadTime,
+           shaderStats.numPending, parallelCompile ? "yes" : "no");
 }
 
-void paintGL() {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+std::vector<Camera> viewCameras() {
+    // Views at equal angles around the target of the camera (multi-camera preview)
+    std::vector<Camera> cameras(numViews, camera);
+    for (int i = 1; i < numViews; i++) {
+        const glm::mat4 rotate = glm::rotate(2.0f * PI * i / numViews, camera.up);
+        cameras[i].pos = camera.dir + glm::vec3(rotate * glm::vec4(camera.pos - camera.dir, 0.0f));
+        cameras[i].viewMat = glm::lookAt(cameras[i].pos, cameras[i].dir, cameras[i].up);
+    }
+    return cameras;
+}
 
-    // indirectSurface
-    indirectSurface->draw(camera, pointLight, volTex);
+void forEachView(const std::vector<Camera> &cameras, const std::function<void(const Camera &)> &func) {
+    if (cameras.size() != viewFbos.size()) {
+        FatalError("%d cameras are given for %d views!", (int)cameras.size(), (int)viewFbos.size());
+    }
 
-    // directly visible volume (ray marching)
-    directVolume->draw(camera, pointLight, volTex);
+    // Each view has its own target and history (temporal accumulation, occlusion culling)
+    for (int i = 0; i < (int)cameras.size(); i++) {
+        const auto &target = viewFbos[i];
+        directVolume->setView(i);
+        directVolume->setSceneDepthTexture(target->depthTexture());
+        indirectSurface->setView(i);
+        indirectSurface->setSceneDepthTexture(target->depthTexture());
 
-    if (volTex->numFrames() > 1) {
-        updateVolume();
+        target->bind();
+        glViewport(0, 0, target->width(), target->height());
+        func(cameras[i]);
+        target->release();
     }
+    glViewport(0, 0, sceneFbo->width(), sceneFbo->height());
+}
+
+void composeViews() {
+    if (viewFbos.size() == 1 && viewFbos[0] == sceneFbo) {
+        return;
+    }
+
+    // Views side by side in the scene buffer (columns left by the division are cleared)
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sceneFbo->getId());
+    glClear(GL_COLOR_BUFFER_BIT);
+    for (int i = 0; i < (int)viewFbos.size(); i++) {
+        const auto &target = viewFbos[i];
+        const int x = i * target->width();
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, target->getId());
+        glBlitFramebuffer(0, 0, target->width(), target->height(), x, 0, x + target->width(), target->height(),
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+}
+
+void paintViews(const std::vector<Camera> &cameras) {
+    forEachView(cameras, [](const Camera &viewCamera) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // indirectSurface
+        indirectSurface->draw(viewCamera, pointLight, volumes);
+
+        // directly visible volumes (ray marching, terminated by the depth of the surfaces)
+        directVolume->draw(viewCamera, pointLight, volumes);
+    });
+    composeViews();
+
+    // Camera-independent work, once for all the views
+    updateVolume();
+}
+
+bool paintGL() {
+    // Unchanged inputs reproduce the last image, which is still in the scene buffer
+    const std::vector<Camera> cameras = viewCameras();
+    frameState.setSettleFrames(directVolume->isTemporalAccumulationEnabled() ? TEMPORAL_SETTLE_FRAMES : 1);
+    if (!frameState.needsRender(cameras, pointLight, volumes.revision(), indirectSurface->sceneRevision())) {
+        return false;
+    }
+
+    paintViews(cameras);
+    return true;
+}
+
+void presentSceneBuffer() {
+    // Copy the scene buffer to the window
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFbo->getId());
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, sceneFbo->width(), sceneFbo->height(), 0, 0, sceneFbo->width(), sceneFbo->height(),
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 }
 
 void resize(GLFWwindow* window, int width, int height) {
@@ -184,21 +441,611 @@ void resize(GLFWwindow* window, int width, int height) {
     int renderBufferWidth, renderBufferHeight;
     glfwGetFramebufferSize(window, &renderBufferWidth, &renderBufferHeight);
     glViewport(0, 0, renderBufferWidth, renderBufferHeight);
-
-    // Update camera
-    camera.projMat = glm::perspective(glm::radians(45.0f), float(width) / float(height), 0.1f, 1000.0f);
+    resizeSceneBuffer(renderBufferWidth, renderBufferHeight);
+    frameState.invalidate();
 }
 
 void keyboard(GLFWwindow *window, int key, int scancode, int action, int mods) {
     if (action == GLFW_PRESS) {
+        // Most of the keys change render settings, which are not tracked by the frame state
+        frameState.invalidate();
+
         if (key == GLFW_KEY_ESCAPE) {
             glfwSetWindowShouldClose(window, true);
         }
 
         if (key == GLFW_KEY_S && mods == GLFW_MOD_CONTROL) {
-            saveCurrentBuffer(window, "output.png");
+            saveSceneBuffer("output.png");
+        }
+
+        if (key == GLFW_KEY_V) {
+            // Toggle vertex-rate indirect illumination for rough surfaces
+            indirectSurface->setVertexRateEnabled(!indirectSurface->isVertexRateEnabled());
+            printf("Vertex-rate indirect: %s\n", indirectSurface->isVertexRateEnabled() ? "ON" : "OFF");
+        }
+
+        if (key == GLFW_KEY_F) {
+            // Switch volume filtering between Gaussian mip chain and summed-area table
+            const bool useSat = volumes.filterMode() != VolumeFilterMode::SummedAreaTable;
+            volumes.setFilterMode(useSat ? VolumeFilterMode::SummedAreaTable : VolumeFilterMode::MipGaussian);
+
+            // Build cost of the filter including the mip chain of the Gaussian filter (lookup cost
+            // is reflected in the frame time of the title)
+            static GLtimer filterTimer;  // created on the first press, and its queries are reused
+            for (int i = 0; i < volumes.size(); i++) {
+                volumes[i].injectRadiance(pointLight.pos, pointLight.Le);
+            }
+            filterTimer.start();
+            for (int i = 0; i < volumes.size(); i++) {
+                volumes[i].generateMipmaps();
+                volumes[i].filterVolume();
+            }
+            filterTimer.end();
+            filterTimer.wait();
+            for (int i = 0; i < volumes.size(); i++) {
+                volumes[i].nextFrame();
+                volumes[i].bakeIrradianceProbes();
+            }
+            volumes.markUpdated(pointLight);
+            printf("Volume filter: %s (build: %.3f [ms])\n", useSat ? "summed-area table" : "Gaussian mip chain", filterTimer.getDuration());
+        }
+
+        if (key == GLFW_KEY_A) {
+            // Toggle jittered ray marching with temporal accumulation
+            directVolume->setTemporalAccumulation(!directVolume->isTemporalAccumulationEnabled());
+            printf("Temporal accumulation: %s\n", directVolume->isTemporalAccumulationEnabled() ? "ON" : "OFF");
+        }
+
+        if (key == GLFW_KEY_B) {
+            // Toggle statistics of ray marching steps and LPAL overdraw (shown in the window title)
+            directVolume->setStepStatistics(!directVolume->isStepStatisticsEnabled());
+            indirectSurface->setShadingStatistics(directVolume->isStepStatisticsEnabled());
+        }
+
+        if (key == GLFW_KEY_D) {
+            // Toggle depth pre-pass of the surfaces (LPAL shading only for the visible fragments)
+            indirectSurface->setDepthPrepass(!indirectSurface->isDepthPrepassEnabled());
+            printf("Depth pre-pass: %s\n", indirectSurface->isDepthPrepassEnabled() ? "ON" : "OFF");
+        }
+
+        if (key == GLFW_KEY_C) {
+            // Toggle occlusion culling of the surface instances (against the depth of the previous frame)
+            indirectSurface->setOcclusionCulling(!indirectSurface->isOcclusionCullingEnabled());
+            printf("Occlusion culling: %s\n", indirectSurface->isOcclusionCullingEnabled() ? "ON" : "OFF");
+        }
+
+        if (key == GLFW_KEY_H) {
+            // Cycle the resolution of volume ray marching (full -> half -> quarter)
+            const int scale = directVolume->getResolutionScale() >= 4 ? 1 : directVolume->getResolutionScale() * 2;
+            directVolume->setResolutionScale(scale);
+            printf("Volume resolution: 1/%d\n", scale);
+        }
+
+        if (key == GLFW_KEY_T) {
+            // Toggle screen-space tile classification for LPAL shading
+            indirectSurface->setTileClassification(!indirectSurface->isTileClassificationEnabled());
+            printf("Tile classification: %s\n", indirectSurface->isTileClassificationEnabled() ? "ON" : "OFF");
+        }
+
+        if (key == GLFW_KEY_P) {
+            // Toggle profiling scopes (the tree of the last resolved frame is dumped when turned off)
+            Profiler &profiler = Profiler::instance();
+            if (profiler.isEnabled()) {
+                profiler.dump();
+            }
+            profiler.setEnabled(!profiler.isEnabled());
+            printf("Profiler: %s\n", profiler.isEnabled() ? "ON" : "OFF");
+        }
+
+        if (key == GLFW_KEY_L) {
+            // Cycle the number of frames in flight (latency vs. throughput)
+            framePacer.setFramesInFlight(framePacer.framesInFlight() % FramePacer::MAX_FRAMES_IN_FLIGHT + 1);
+            printf("Frames in flight: %d\n", framePacer.framesInFlight());
+        }
+
+        if (key == GLFW_KEY_O) {
+            // Toggle on-screen overlay of the profiler
+            Profiler &profiler = Profiler::instance();
+            profiler.setOverlayEnabled(!profiler.isOverlayEnabled());
+            if (profiler.isOverlayEnabled()) {
+                profiler.setEnabled(true);
+            }
+        }
+
+        if (key == GLFW_KEY_R) {
+            // Toggle rotation of the camera (a static scene is rendered only when something changes)
+            rotateCamera = !rotateCamera;
+            printf("Camera rotation: %s\n", rotateCamera ? "ON" : "OFF");
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Command line options
+// ----------------------------------------------------------------------------
+
+// Frame number in "--output" ("%d" or "%0Nd"), which is replaced without printf
+struct FrameToken {
+    size_t pos = std::string::npos;
+    size_t length = 0;
+    int width = 0;  // zero-padded width
+};
+
+FrameToken findFrameToken(const std::string &pattern) {
+    FrameToken token;
+    for (size_t i = pattern.find('%'); i != std::string::npos; i = pattern.find('%', i + 1)) {
+        if (token.pos != std::string::npos) {
+            FatalError("Only one frame number is allowed in the output: %s", pattern.c_str());
+        }
+
+        size_t j = i + 1;
+        int width = 0;
+        if (j < pattern.size() && pattern[j] == '0') {
+            for (j++; j < pattern.size() && std::isdigit((unsigned char)pattern[j]); j++) {
+                width = std::min(width * 10 + (pattern[j] - '0'), 32);
+            }
+            if (width == 0) {
+                j = pattern.size();
+            }
+        }
+        if (j >= pattern.size() || pattern[j] != 'd') {
+            FatalError("Invalid frame number in the output (use %%d or %%0Nd): %s", pattern.c_str());
+        }
+
+        token.pos = i;
+        token.length = j + 1 - i;
+        token.width = width;
+        i = j;
+    }
+    return token;
+}
+
+std::string frameFilename(const std::string &pattern, const FrameToken &token, int frame) {
+    std::string number = std::to_string(frame);
+    if ((int)number.size() < token.width) {
+        number.insert(0, token.width - number.size(), '0');
+    }
+    return pattern.substr(0, token.pos) + number + pattern.substr(token.pos + token.length);
+}
+
+struct CommandLineOptions {
+    std::string configFile = "";
+    bool headless = false;
+    bool benchmark = false;
+    bool profile = false;
+    std::string trace = "";
+    int frames = 0;
+    int warmupFrames = 60;
+    int framesInFlight = 2;
+    std::string report = "benchmark.json";
+    int width = WIN_WIDTH;
+    int height = WIN_HEIGHT;
+    std::string output = "output.png";
+    std::string shaderCache = "shader_cache";
+    std::string benchMesh = "";
+    bool depthPrepass = false;
+    bool overdraw = false;
+    bool culling = true;
+    int views = 1;
+    bool staticCamera = false;
+    VolumeFilterMode filter = VolumeFilterMode::MipGaussian;
+};
+
+static const char *USAGE =
+    "[ USAGE ] main.exe [ path to config.txt ] [ options ]\n"
+    "  --headless          render without a window (EGL)\n"
+    "  --frames N          number of frames rendered in headless mode (default: 1)\n"
+    "                      or measured in benchmark mode (default: 300)\n"
+    "  --size WxH          size of the render target in headless mode (default: 960x960)\n"
+    "  --output FILE       output image, \"%04d\" in FILE saves every frame (default: output.png)\n"
+    "  --profile           enable profiling scopes from the start (dumped at exit in headless mode)\n"
+    "  --trace FILE        write CPU and GPU timelines of the scopes as Chrome trace events at exit\n"
+    "  --benchmark         measure GPU time of each pass on a fixed camera and light path\n"
+    "  --frames-in-flight N  maximum number of frames queued on the GPU, 1-3 (default: 2)\n"
+    "  --warmup N          number of frames before the measurement (default: 60)\n"
+    "  --report FILE       benchmark report, CSV if FILE ends with \".csv\" (default: benchmark.json)\n"
+    "  --shader-cache DIR  directory of cached program binaries (default: shader_cache)\n"
+    "  --no-shader-cache   always compile the shader programs from source\n"
+    "  --depth-prepass     draw the depth of the surfaces before the LPAL shading\n"
+    "  --overdraw          count shaded LPAL fragments and ray marching steps per visible pixel (stalls every frame)\n"
+    "  --no-culling        draw all the surface instances (no frustum and occlusion culling)\n"
+    "  --static-camera     keep the camera at its initial position (unchanged frames are not rendered again)\n"
+    "  --filter MODE       volume filter, \"gaussian\" (Gaussian mip chain) or \"sat\" (summed-area table) (default: gaussian)\n"
+    "  --views N           render N views side by side around the camera target, sharing the volume update (1-4, default: 1)\n"
+    "  --bench-mesh FILE   measure OBJ ingestion, optimization and the binary mesh cache of FILE (--frames N repetitions, default: 5)\n";
+
+CommandLineOptions parseCommandLine(int argc, char **argv) {
+    CommandLineOptions options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--frames" && hasValue) {
+            options.frames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--size" && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0) {
+                FatalError("Invalid render target size: %s", argv[i]);
+            }
+        } else if (arg == "--output" && hasValue) {
+            options.output = argv[++i];
+            findFrameToken(options.output);
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg == "--trace" && hasValue) {
+            options.trace = argv[++i];
+        } else if (arg == "--benchmark") {
+            options.benchmark = true;
+        } else if (arg == "--frames-in-flight" && hasValue) {
+            options.framesInFlight = std::atoi(argv[++i]);
+        } else if (arg == "--warmup" && hasValue) {
+            options.warmupFrames = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--report" && hasValue) {
+            options.report = argv[++i];
+        } else if (arg == "--shader-cache" && hasValue) {
+            options.shaderCache = argv[++i];
+        } else if (arg == "--no-shader-cache") {
+            options.shaderCache = "";
+        } else if (arg == "--depth-prepass") {
+            options.depthPrepass = true;
+        } else if (arg == "--overdraw") {
+            options.overdraw = true;
+        } else if (arg == "--no-culling") {
+            options.culling = false;
+        } else if (arg == "--static-camera") {
+            options.staticCamera = true;
+        } else if (arg == "--filter" && hasValue) {
+            const std::string mode = argv[++i];
+            if (mode == "gaussian") {
+                options.filter = VolumeFilterMode::MipGaussian;
+            } else if (mode == "sat") {
+                options.filter = VolumeFilterMode::SummedAreaTable;
+            } else {
+                FatalError("Invalid volume filter: %s (gaussian or sat)", mode.c_str());
+            }
+        } else if (arg == "--views" && hasValue) {
+            options.views = std::atoi(argv[++i]);
+            if (options.views < 1 || options.views > MAX_VIEWS) {
+                FatalError("Invalid number of views: %s (1-%d)", argv[i], MAX_VIEWS);
+            }
+        } else if (arg == "--bench-mesh" && hasValue) {
+            options.benchMesh = argv[++i];
+        } else if (arg[0] != '-' && options.configFile.empty()) {
+            options.configFile = arg;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n%s", arg.c_str(), USAGE);
+            std::exit(1);
+        }
+    }
+
+    if (options.configFile.empty() && options.benchMesh.empty()) {
+        fprintf(stderr, "%s", USAGE);
+        std::exit(1);
+    }
+
+    if (options.frames <= 0) {
+        options.frames = options.benchmark ? 300 : !options.benchMesh.empty() ? 5 : 1;
+    }
+
+    return options;
+}
+
+void applyRenderOptions(const CommandLineOptions &options) {
+    indirectSurface->setDepthPrepass(options.depthPrepass);
+    indirectSurface->setShadingStatistics(options.overdraw);
+    directVolume->setStepStatistics(options.overdraw);
+    indirectSurface->setFrustumCulling(options.culling);
+    indirectSurface->setOcclusionCulling(options.culling);
+    volumes.setFilterMode(options.filter);
+}
+
+void finishProfiling(const CommandLineOptions &options) {
+    // Resolve the frames in flight while the context is still alive
+    if (!options.profile && options.trace.empty()) {
+        return;
+    }
+
+    Profiler::instance().finish();
+    if (options.profile) {
+        Profiler::instance().dump();
+    }
+    if (!options.trace.empty()) {
+        TraceRecorder::instance().stop();
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Benchmark mode
+// ----------------------------------------------------------------------------
+
+enum BenchmarkPass {
+    PASS_INJECT = 0,
+    PASS_MIP,
+    PASS_FILTER,
+    PASS_PROBE,
+    PASS_SURFACE,
+    PASS_VOLUME,
+    PASS_FRAME,
+    NUM_BENCHMARK_PASSES
+};
+
+static const std::vector<std::string> BENCHMARK_PASS_NAMES = {
+    "inject", "mip", "filter", "probe", "surface", "volume", "frame"
+};
+
+void paintBenchmarkFrame(int frame, std::vector<GLtimer> &timers) {
+    // Deterministic scene state (the volume is updated every frame as the light moves)
+    updateCamera(frame);
+    updateLight(frame);
+
+    // Each pass is enclosed by its own timer (timestamps, so "frame" can enclose them)
+    const auto timePass = [&](BenchmarkPass pass, const std::function<void()> &func) {
+        timers[pass].start();
+        func();
+        timers[pass].end();
+    };
+
+    timers[PASS_FRAME].start();
+    {
+        // Every volume is updated in each pass (the light moves)
+        const auto forEachVolume = [](const std::function<void(VolumeTexture &)> &func) {
+            for (int i = 0; i < volumes.size(); i++) {
+                func(volumes[i]);
+            }
+        };
+        timePass(PASS_INJECT, [&] { forEachVolume([](VolumeTexture &v) { v.injectRadiance(pointLight.pos, pointLight.Le); }); });
+        timePass(PASS_MIP, [&] { forEachVolume([](VolumeTexture &v) { v.generateMipmaps(); }); });
+        timePass(PASS_FILTER, [&] { forEachVolume([](VolumeTexture &v) { v.filterVolume(); }); });
+        timePass(PASS_PROBE, [&] { forEachVolume([](VolumeTexture &v) { v.bakeIrradianceProbes(); }); });
+        forEachVolume([](VolumeTexture &v) { v.nextFrame(); });
+
+        // Each pass covers all the views
+        const std::vector<Camera> cameras = viewCameras();
+        forEachView(cameras, [](const Camera &) { glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); });
+        timePass(PASS_SURFACE, [&] {
+            forEachView(cameras, [](const Camera &viewCamera) { indirectSurface->draw(viewCamera, pointLight, volumes); });
+        });
+        timePass(PASS_VOLUME, [&] {
+            forEachView(cameras, [](const Camera &viewCamera) { directVolume->draw(viewCamera, pointLight, volumes); });
+        });
+        composeViews();
+    }
+    timers[PASS_FRAME].end();
+}
+
+void runBenchmark(const CommandLineOptions &options, const std::function<bool()> &present) {
+    BenchmarkReport report(BENCHMARK_PASS_NAMES);
+    report.setProperty("vendor", (const char *)glGetString(GL_VENDOR));
+    report.setProperty("renderer", (const char *)glGetString(GL_RENDERER));
+    report.setProperty("version", (const char *)glGetString(GL_VERSION));
+    report.setProperty("resolution", std::to_string(sceneFbo->width()) + "x" + std::to_string(sceneFbo->height()));
+    report.setProperty("filter", volumes.filterMode() == VolumeFilterMode::SummedAreaTable ? "summed-area table" : "Gaussian mip chain");
+    report.setProperty("volumes", std::to_string(volumes.size()));
+    report.setProperty("views", std::to_string(numViews));
+    report.setProperty("frames_in_flight", std::to_string(framePacer.framesInFlight()));
+    report.setProperty("depth_prepass", indirectSurface->isDepthPrepassEnabled() ? "on" : "off");
+    report.setProperty("instances", std::to_string(indirectSurface->numInstances()));
+    report.setProperty("instance_culling", indirectSurface->isOcclusionCullingEnabled() ? "frustum + occlusion" :
+                                           indirectSurface->isFrustumCullingEnabled() ? "frustum" : "off");
+    report.setProperty("warmup_frames", std::to_string(options.warmupFrames));
+    report.setProperty("measured_frames", std::to_string(options.frames));
+
+    const auto &shaderStats = ShaderProgram::cacheStatistics();
+    report.setProperty("startup_ms", std::to_string(startupTime));
+    report.setProperty("programs_compiled", std::to_string(shaderStats.numCompiled));
+    report.setProperty("programs_cached", std::to_string(shaderStats.numLoaded));
+
+    // Timer results arrive a few frames later in issue order, so the warm-up frames are skipped by counting them
+    std::vector<GLtimer> timers(NUM_BENCHMARK_PASSES);
+    std::vector<int> resolvedFrames(NUM_BENCHMARK_PASSES, 0);
+    const auto collectSamples = [&]() {
+        for (int pass = 0; pass < NUM_BENCHMARK_PASSES; pass++) {
+            double duration;
+            while (timers[pass].popResult(duration)) {
+                if (resolvedFrames[pass]++ >= options.warmupFrames) {
+                    report.addSample(pass, duration);
+                }
+            }
         }
+    };
+
+    printf("Benchmark: %d warm-up frames, %d measured frames\n", options.warmupFrames, options.frames);
+    const int totalFrames = options.warmupFrames + options.frames;
+    double stepsPerPixel = 0.0;
+    for (int frame = 0; frame < totalFrames; frame++) {
+        framePacer.beginFrame();
+        Profiler::instance().beginFrame();
+        paintBenchmarkFrame(frame, timers);
+        Profiler::instance().endFrame();
+        if (frame >= options.warmupFrames) {
+            stepsPerPixel += directVolume->averageStepsPerPixel();
+        }
+        collectSamples();
+        if (!present()) {
+            fprintf(stderr, "Benchmark was interrupted at frame %d\n", frame);
+            return;
+        }
+        framePacer.endFrame();
+
+        if (frame == 0) {
+            reportFirstFrame();
+        }
+    }
+
+    for (auto &timer : timers) {
+        timer.wait();
     }
+    collectSamples();
+
+    report.setProperty("time_to_first_frame_ms", std::to_string(timeToFirstFrame));
+    if (indirectSurface->isShadingStatisticsEnabled()) {
+        report.setProperty("lpal_overdraw", std::to_string(indirectSurface->overdraw()));
+        report.setProperty("visible_instances", std::to_string(indirectSurface->numVisibleInstances()));
+    }
+    if (directVolume->isStepStatisticsEnabled()) {
+        // Average over the measured frames (the camera moves along the path)
+        report.setProperty("steps_per_pixel", std::to_string(stepsPerPixel / options.frames));
+    }
+    report.print();
+    report.save(options.report);
+}
+
+// ----------------------------------------------------------------------------
+// Mesh loading benchmark
+// ----------------------------------------------------------------------------
+
+enum MeshBenchmarkPass {
+    MESH_OBJ_SERIAL = 0,
+    MESH_OBJ_PARALLEL,
+    MESH_OPTIMIZE,
+    MESH_BINARY_SAVE,
+    MESH_BINARY_LOAD,
+    NUM_MESH_BENCHMARK_PASSES
+};
+
+static const std::vector<std::string> MESH_BENCHMARK_PASS_NAMES = {
+    "obj-serial", "obj-mt", "optimize", "bin-save", "bin-load"
+};
+
+int runMeshBenchmark(const CommandLineOptions &options) {
+    // CPU only (no GL context): OBJ parsing with serial / parallel deduplication, optimization and the binary cache
+    const std::string &objFile = options.benchMesh;
+    const std::string binFile = MeshData::binaryPath(objFile);
+    const int numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+    BenchmarkReport report(MESH_BENCHMARK_PASS_NAMES);
+    const auto timePass = [&](MeshBenchmarkPass pass, const std::function<void()> &func) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        func();
+        report.addSample(pass, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+    };
+
+    printf("Mesh benchmark: %s, %d repetitions, %d threads\n", objFile.c_str(), options.frames, numThreads);
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    MeshData mesh;
+    for (int i = 0; i < options.frames; i++) {
+        timePass(MESH_OBJ_SERIAL, [&] { MeshData::loadObj(objFile, vertices, indices, 1); });
+        timePass(MESH_OBJ_PARALLEL, [&] { MeshData::loadObj(objFile, vertices, indices, numThreads); });
+        timePass(MESH_OPTIMIZE, [&] { mesh = MeshData::build(vertices, indices); });
+        timePass(MESH_BINARY_SAVE, [&] { mesh.saveBinary(binFile, objFile); });
+        timePass(MESH_BINARY_LOAD, [&] {
+            if (!MeshData::loadBinary(binFile, mesh, objFile)) {
+                FatalError("Failed to load the mesh cache: %s", binFile.c_str());
+            }
+        });
+    }
+
+    report.setProperty("mesh", objFile);
+    report.setProperty("vertices", std::to_string(mesh.vertices.size()));
+    report.setProperty("triangles", std::to_string(mesh.indices.size() / 3));
+    report.setProperty("acmr_input", std::to_string(averageCacheMissRatio(indices, vertices.size())));
+    report.setProperty("acmr_optimized", std::to_string(averageCacheMissRatio(mesh.indices, mesh.vertices.size())));
+    report.setProperty("threads", std::to_string(numThreads));
+    report.setProperty("repetitions", std::to_string(options.frames));
+    printf("%zu vertices, %zu triangles\n", mesh.vertices.size(), mesh.indices.size() / 3);
+    report.print();
+    report.save(options.report);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Headless mode
+// ----------------------------------------------------------------------------
+
+int runHeadless(const CommandLineOptions &options) {
+#ifdef USE_HEADLESS_EGL
+    // OpenGL context without window
+    HeadlessContext context;
+    context.create();
+    context.makeCurrent();
+
+    if (gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress) != GL_TRUE) {
+        FatalError("GLAD: failed to load OpenGL library!");
+    }
+    printf("OpenGL: %s (%s)\n", glGetString(GL_VERSION), glGetString(GL_RENDERER));
+
+    // There is no default framebuffer, so the scene buffer is the only render target
+    glViewport(0, 0, options.width, options.height);
+    initializeGL();
+    applyRenderOptions(options);
+
+    if (options.benchmark) {
+        runBenchmark(options, [] { return true; });
+    } else {
+        // Render a fixed number of frames (camera moves in the same way as the window mode)
+        const FrameToken frameToken = findFrameToken(options.output);
+        const bool saveEveryFrame = frameToken.pos != std::string::npos;
+        GLtimer timer;
+        uint64_t shadedFragments = 0;
+        uint64_t visiblePixels = 0;
+        double stepsPerPixel = 0.0;
+        for (int frame = 0; frame < options.frames; frame++) {
+            framePacer.beginFrame();
+            Profiler::instance().beginFrame();
+            timer.start();
+            bool rendered;
+            {
+                rendered = paintGL();
+            }
+            timer.end();
+            if (rendered) {
+                shadedFragments += indirectSurface->numShadedFragments();
+                visiblePixels += indirectSurface->numVisiblePixels();
+                stepsPerPixel += directVolume->averageStepsPerPixel();
+            }
+            Profiler::instance().endFrame();
+            framePacer.endFrame();
+
+            if (frame == 0) {
+                reportFirstFrame();
+            }
+
+            if (saveEveryFrame) {
+                saveSceneBuffer(frameFilename(options.output, frameToken, frame));
+            }
+
+            if (rotateCamera) {
+                updateCamera(cameraFrame++);
+            }
+        }
+
+        if (!saveEveryFrame) {
+            saveSceneBuffer(options.output);
+        }
+        timer.wait();
+        printf("Headless: %d frames, %.3f [ms/frame] (%d rendered, %d unchanged)\n", options.frames, timer.getDuration(options.frames),
+               frameState.numRenderedFrames(), frameState.numSkippedFrames());
+        if (indirectSurface->isShadingStatisticsEnabled()) {
+            printf("LPAL overdraw: %.3fx (%.0f shaded fragments, %.0f visible pixels per rendered frame, depth pre-pass: %s)\n",
+                   visiblePixels != 0 ? (double)shadedFragments / (double)visiblePixels : 0.0,
+                   (double)shadedFragments / std::max(frameState.numRenderedFrames(), 1),
+                   (double)visiblePixels / std::max(frameState.numRenderedFrames(), 1),
+                   indirectSurface->isDepthPrepassEnabled() ? "ON" : "OFF");
+            printf("Visible instances: %u of %d (last frame)\n", indirectSurface->numVisibleInstances(), indirectSurface->numInstances());
+        }
+        if (directVolume->isStepStatisticsEnabled()) {
+            printf("Ray marching: %.2f steps per pixel (average of the rendered frames)\n",
+                   stepsPerPixel / std::max(frameState.numRenderedFrames(), 1));
+        }
+    }
+
+    finishProfiling(options);
+
+    // Release GL resources while the context is still current
+    indirectSurface.reset();
+    directVolume.reset();
+    volumes.clear();
+    viewFbos.clear();
+    sceneFbo.reset();
+    framePacer.destroy();
+    context.destroy();
+
+    return 0;
+#else
+    FatalError("Headless mode is not available. Configure with -DWITH_HEADLESS=ON to enable it.");
+    return 1;
+#endif
 }
 
 // ----------------------------------------------------------------------------
@@ -206,13 +1053,29 @@ void keyboard(GLFWwindow *window, int key, int scancode, int action, int mods) {
 // ----------------------------------------------------------------------------
 
 int main(int argc, char **argv) {
-    if (argc <= 1) {
-        fprintf(stderr, "[ USAGE ] main.exe [ path to config.txt ]\n");
-        std::exit(1);
+    const CommandLineOptions options = parseCommandLine(argc, argv);
+
+    if (!options.benchMesh.empty()) {
+        return runMeshBenchmark(options);
     }
 
     // Load config
-    config.load(argv[1]);
+    config.load(options.configFile);
+    framePacer.setFramesInFlight(options.framesInFlight);
+    numViews = options.views;
+    rotateCamera = !options.staticCamera;
+    ShaderProgram::setBinaryCacheDirectory(options.shaderCache);
+    Profiler::instance().setEnabled(options.profile || !options.trace.empty());
+    if (!options.trace.empty()) {
+        TraceRecorder::instance().start(options.trace);
+    }
+
+    // Asset loading overlaps with the context creation and the shader compilation
+    startAssetLoading();
+
+    if (options.headless) {
+        return runHeadless(options);
+    }
 
     // Setup GLFW
     if (glfwInit() == GL_FALSE) {
@@ -240,11 +1103,27 @@ int main(int argc, char **argv) {
 
     // Initialize general OpenGL functinalities
     initializeGL();
+    applyRenderOptions(options);
 
     // Set callback functions
     glfwSetWindowSizeCallback(window, resize);
     glfwSetKeyCallback(window, keyboard);
 
+    if (options.benchmark) {
+        runBenchmark(options, [window] {
+            presentSceneBuffer();
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            return glfwWindowShouldClose(window) == GL_FALSE;
+        });
+
+        finishProfiling(options);
+        framePacer.destroy();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return 0;
+    }
+
     // Timer for indicating fps
     GLtimer timer;
     timer.start();
@@ -254,29 +1133,59 @@ int main(int argc, char **argv) {
 
     // Mainloop
     while (glfwWindowShouldClose(window) == GL_FALSE) {
+        // Wait until the number of frames queued on the GPU drops below the limit
+        framePacer.beginFrame();
+
         // Draw
+        Profiler::instance().beginFrame();
         timer.start();
+        bool rendered;
         {
-            paintGL();
+            rendered = paintGL();
+            presentSceneBuffer();
         }
         timer.end();
 
+        if (Profiler::instance().isOverlayEnabled()) {
+            Profiler::instance().drawOverlay(sceneFbo->width(), sceneFbo->height());
+        }
+        Profiler::instance().endFrame();
+
         // Update scene params
-        updateCamera(frames);
+        if (rotateCamera) {
+            updateCamera(cameraFrame++);
+        }
 
-        // Display time and fps
-        if (frames % fpsInterval == 0) {
+        // Display time and fps (timer results arrive a few frames later)
+        if (frames % fpsInterval == 0 && timer.numResolved() > 0) {
             char title[256];
             const double duration = timer.getDuration(fpsInterval);
-            sprintf(title, "%s: %.2f [fps], %.3f [ms/frame]", WIN_TITLE, 1000.0 / duration, duration);
+            if (directVolume->isStepStatisticsEnabled()) {
+                sprintf(title, "%s: %.2f [fps], %.3f [ms/frame], %.1f [steps/pixel], %.2fx [LPAL overdraw]", WIN_TITLE,
+                        1000.0 / duration, duration, directVolume->averageStepsPerPixel(), indirectSurface->overdraw());
+            } else {
+                sprintf(title, "%s: %.2f [fps], %.3f [ms/frame]", WIN_TITLE, 1000.0 / duration, duration);
+            }
             glfwSetWindowTitle(window, title);
         }
 
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        framePacer.endFrame();
+        if (frames == 0) {
+            reportFirstFrame();
+        }
+
+        // Nothing changes in a static scene until an input arrives (the GPU stays idle)
+        if (rendered) {
+            glfwPollEvents();
+        } else {
+            glfwWaitEvents();
+        }
         frames++;
     }
 
+    finishProfiling(options);
+    framePacer.destroy();
     glfwDestroyWindow(window);
     glfwTerminate();
 
@@ -0,0 +1,18 @@
+#version 450
+
+in vec2 f_texcoord;
+
+out vec4 out_color;
+
+uniform sampler2D u_colorTex;
+uniform sampler2D u_depthTex;
+
+void main(void) {
+    float depth = texture(u_depthTex, f_texcoord).x;
+    if (depth >= 1.0) {
+        discard;
+    }
+
+    out_color = texture(u_colorTex, f_texcoord);
+    gl_FragDepth = depth;
+}
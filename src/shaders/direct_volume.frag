@@ -3,7 +3,8 @@
 in vec3 f_texcoord;
 in vec3 f_vertPosWorld;
 
-out vec4 out_color;
+layout(location = 0) out vec4 out_color;
+layout(location = 1) out vec4 out_depth;  // X: window depth of the ray entry, Y: distance for reprojection, Z: scene depth
 
 uniform vec3 u_cameraPos;
 uniform int u_sampleNum;
@@ -11,9 +12,35 @@ uniform vec3 u_albedo;
 uniform vec3 u_marginCubeVertices[8];
 
 uniform sampler3D u_filteredTex;
+uniform sampler3D u_satTex;
+
+// Adaptive stepping
+uniform float u_pixelAngle;          // view angle covered by a pixel (distance-adaptive step)
+uniform float u_emptySpaceLOD;       // mip level tested to take long steps in empty space
+uniform float u_emptyStepScale = 4.0;
+uniform float u_opacityCutoff = 0.99;
+
+// Depth of opaque surfaces (rays are terminated at them)
+uniform bool u_useSceneDepth = false;
+uniform sampler2D u_sceneDepthTex;
+uniform mat4 u_invViewProjMat;
+uniform vec2 u_viewportSize;  // size of the ray marching target (may be lower than the scene)
+
+// Jittering (for temporal accumulation)
+uniform bool u_jitter = false;
+uniform int u_frameIndex = 0;
+
+// Statistics
+uniform bool u_countSteps = false;
+layout(std430, binding = 0) buffer StepCounter {
+    uint totalSteps;
+    uint totalRays;
+};
 
 const float eps = 1.0e-6;
 
+#include "volume_sampling.glsl"
+
 vec3 gammaCorrection(vec3 color) { 
     return pow(clamp(color, 0.0, 1.0), vec3(1.0 / 2.2));
 }
@@ -22,13 +49,18 @@ float toGrayScale(vec3 col) {
     return col.r * 0.299 + col.g * 0.589 + col.b * 0.112;
 }
 
+float interleavedGradientNoise(vec2 pixel) {
+    // Cheap low-discrepancy noise in screen space (used in place of a blue noise texture),
+    // shifted every frame so that the accumulated samples cover the whole step
+    pixel += 5.588238 * float(u_frameIndex % 64);
+    return fract(52.9829189 * fract(dot(pixel, vec2(0.06711056, 0.00583715))));
+}
+
 void main(void) {
   float edgeLength = length(u_marginCubeVertices[0] - u_marginCubeVertices[3]);
+  float baseStep = edgeLength / u_sampleNum;
 
-  float scale = edgeLength / u_sampleNum;
-  float texScale = scale / edgeLength;
-
-  vec3 rayDir = normalize(f_vertPosWorld - u_cameraPos) * scale;
+  vec3 rayDir = normalize(f_vertPosWorld - u_cameraPos);
   vec3 U = u_marginCubeVertices[1] - u_marginCubeVertices[0];
   vec3 V = u_marginCubeVertices[2] - u_marginCubeVertices[0];
   vec3 W = u_marginCubeVertices[3] - u_marginCubeVertices[0];
@@ -42,22 +74,53 @@ void main(void) {
   float du = dot(rayDir, eU) / lU;
   float dv = dot(rayDir, eV) / lV;
   float dw = dot(rayDir, eW) / lW;
-  vec3 texRayDir = normalize(vec3(du, dv, dw)) * texScale;
+  vec3 texRayDir = normalize(vec3(du, dv, dw)) / edgeLength;  // per unit length in world space
 
   // parameters that will be updated
-  vec3 texPos = vec3(f_texcoord.x, f_texcoord.y, f_texcoord.z);
+  float entryDist = length(f_vertPosWorld - u_cameraPos);
+  float t = u_jitter ? interleavedGradientNoise(gl_FragCoord.xy) * baseStep : 0.0;
+  vec3 texPos = f_texcoord + t * texRayDir;
+  float hitDist = entryDist;
+  bool hit = false;
 
   // transmittance
   vec3 T = vec3(1.0);
   // in-scattered radiance
   vec3 Lo = vec3(0.0);
 
-  for (int i = 0; i < u_sampleNum; i++) {      
-      // skip empty space
-      float density = textureLod(u_filteredTex, texPos, 0).w;
+  // distance to the opaque surface behind the entry point
+  float maxT = 1.0e20;
+  float sceneDepth = 1.0;
+  if (u_useSceneDepth) {
+      vec2 screenUV = gl_FragCoord.xy / u_viewportSize;
+      sceneDepth = texelFetch(u_sceneDepthTex, ivec2(screenUV * vec2(textureSize(u_sceneDepthTex, 0))), 0).x;
+      if (sceneDepth < 1.0) {
+          vec4 surfPos = u_invViewProjMat * vec4(vec3(screenUV, sceneDepth) * 2.0 - 1.0, 1.0);
+          maxT = length(surfPos.xyz / surfPos.w - u_cameraPos) - entryDist;
+      }
+  }
+
+  int steps = 0;
+  const int maxSteps = 4 * u_sampleNum;
+  for (; steps < maxSteps; steps++) {
+      if (texPos.x > 1.0 || texPos.y > 1.0 || texPos.z > 1.0 ||
+          texPos.x < 0.0 || texPos.y < 0.0 || texPos.z < 0.0) { break; }
+
+      if (t >= maxT) { break; }
+
+      // step size grows with the pixel footprint at a distance (and the last one ends at the surface)
+      float scale = min(max(baseStep, (entryDist + t) * u_pixelAngle), maxT - t);
+
+      vec4 value = textureLod(u_filteredTex, texPos, 0);
+      float density = value.w;
       if (density > eps) {
+          if (!hit) {
+              hit = true;
+              hitDist = entryDist + t;
+          }
+
           // sample radiance and density
-          vec3 Lri = textureLod(u_filteredTex, texPos, 0).xyz;
+          vec3 Lri = value.xyz;
           vec3 Jss = Lri;
 
           Lo += T * Jss * scale;
@@ -68,15 +131,22 @@ void main(void) {
           vec3 sigmaT = sigmaS + sigmaA;
           T *= exp(-scale * sigmaT);
 
-          if (all(lessThan(T, vec3(eps)))) { break; }
+          if (all(lessThan(T, vec3(1.0 - u_opacityCutoff)))) { break; }
+      } else if (sampleVolume(u_filteredTex, u_satTex, texPos, u_emptySpaceLOD).w <= eps) {
+          // skip empty space with long steps
+          scale = min(scale * u_emptyStepScale, maxT - t);
       }
 
-      texPos += texRayDir;
+      t += scale;
+      texPos += scale * texRayDir;
+  }
 
-      if (texPos.x > 1.0 || texPos.y > 1.0 || texPos.z > 1.0 ||
-          texPos.x < 0.0 || texPos.y < 0.0 || texPos.z < 0.0) { break; }
+  if (u_countSteps) {
+      atomicAdd(totalSteps, uint(steps));
+      atomicAdd(totalRays, 1u);
   }
 
   out_color.rgb = gammaCorrection(Lo);
   out_color.a = 1.0 - toGrayScale(T);
+  out_depth = vec4(gl_FragCoord.z, hitDist, sceneDepth, 0.0);
 }
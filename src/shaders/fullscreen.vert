@@ -0,0 +1,10 @@
+#version 450
+
+out vec2 f_texcoord;
+
+void main(void) {
+    // Single triangle covering the whole screen (no vertex buffer is needed)
+    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    f_texcoord = pos;
+    gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -1,24 +1,47 @@
 #version 450
 
-layout(location = 0) in vec3 in_position;
+layout(location = 0) in vec3 in_position;    // unorm16
 layout(location = 1) in vec2 in_texcoord;
-layout(location = 2) in vec3 in_normal;
+layout(location = 2) in vec2 in_normal;      // octahedral
+layout(location = 3) in uint in_instance;    // "baseInstance" of the draw command
 
 out vec3 f_vertPosWorld;
 out vec2 f_texcoord;
 out vec3 f_normalWorld;
+out vec3 f_vertexIndirect;
+flat out uint f_material;
 
-uniform vec3 u_lightPos;
-uniform mat4 u_lightMat;
+// Same depth as the depth-only pre-pass, which uses this shader in another program
+invariant gl_Position;
 
-uniform mat4 u_mMat;
-uniform mat4 u_mvMat;
-uniform mat4 u_mvpMat;
-uniform mat4 u_normMat;
+uniform mat4 u_viewProjMat;
+uniform bool u_useVertexRate = false;
+
+// Written by "vertexIndirect.comp"
+layout(std430, binding = 1) readonly buffer IndirectBuffer {
+    vec4 vertexIndirect[];
+};
+
+#include "vertex_format.glsl"
+#include "surface_instances.glsl"
 
 void main(void) {
-    gl_Position = u_mvpMat * vec4(in_position, 1.0);
-    f_vertPosWorld = (u_mMat * vec4(in_position, 1.0)).xyz;
+    const SurfaceInstance inst = instances[in_instance];
+    const SurfaceMesh mesh = meshes[inst.mesh];
+
+    vec3 position = decodePosition(in_position, mesh.positionOffset.xyz, mesh.positionScale.xyz);
+    vec3 normal = decodeNormal(in_normal);
+
+    vec4 posWorld = inst.modelMat * vec4(position, 1.0);
+    gl_Position = u_viewProjMat * posWorld;
+    f_vertPosWorld = posWorld.xyz;
     f_texcoord = vec2(in_texcoord.x, in_texcoord.y);
-    f_normalWorld = (u_mMat * vec4(in_normal, 0.0)).xyz;
+    f_normalWorld = (inst.modelMat * vec4(normal, 0.0)).xyz;
+    f_material = inst.material;
+
+    f_vertexIndirect = vec3(0.0);
+    if (u_useVertexRate) {
+        // gl_VertexID includes "baseVertex" of the mesh
+        f_vertexIndirect = vertexIndirect[inst.vertexIndirectOffset + uint(gl_VertexID) - mesh.baseVertex].rgb;
+    }
 }
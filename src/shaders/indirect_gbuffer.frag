@@ -0,0 +1,38 @@
+#version 450
+
+// ----------------------------------------------------------------------------
+// Input
+// ----------------------------------------------------------------------------
+in vec3 f_vertPosWorld;
+in vec2 f_texcoord;
+in vec3 f_normalWorld;
+in vec3 f_vertexIndirect;
+flat in uint f_material;
+
+// ----------------------------------------------------------------------------
+// Output
+// ----------------------------------------------------------------------------
+layout(location = 0) out vec4 out_position;  // XYZ: world position, W: roughness
+layout(location = 1) out vec4 out_normal;    // XYZ: world normal, W: material index + 1 (0: not covered)
+layout(location = 2) out vec4 out_indirect;  // XYZ: vertex-rate indirect illumination, W: 1 if it replaces LPAL
+
+// ----------------------------------------------------------------------------
+// Parameters
+// ----------------------------------------------------------------------------
+#include "surface_materials.glsl"
+
+uniform bool u_useVertexRate = false;
+
+void main(void) {
+    const SurfaceMaterial material = materials[f_material];
+    float alpha = materialRoughness(material, f_texcoord);
+
+    out_position = vec4(f_vertPosWorld, alpha);
+    out_normal = vec4(normalize(f_normalWorld), float(f_material + 1u));
+
+    // Same choice as "indirect_LPAL.frag": rough enough to use the result evaluated per vertex
+    out_indirect = vec4(0.0);
+    if (u_useVertexRate && alpha >= material.vertexRateThreshold) {
+        out_indirect = vec4(f_vertexIndirect, 1.0);
+    }
+}
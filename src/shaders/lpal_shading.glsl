@@ -0,0 +1,84 @@
+// ----------------------------------------------------------------------------
+// Constants and per-draw parameters of the LPAL shading, and the culling of the volumes
+// against the shading points. This file is included by "lpal_common.glsl" and by
+// "classifyTiles.comp", which sorts out the tiles without volume contribution.
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+// Constants
+// ----------------------------------------------------------------------------
+const float EPS = 1.0e-6;
+const float PI = 3.14159265358979323846264338327950288;
+const float TWO_PI = 2.0 * PI;
+const float HALF_PI = 0.5 * PI;
+const float INV_PI = 1.0 / PI;
+const float INV_TWO_PI = 1.0 / TWO_PI;
+const float INV_HALF_PI = 1.0 / HALF_PI;
+
+const float HALF_FLOAT_MAX = 65504.0;
+
+// ----------------------------------------------------------------------------
+// Parameters
+// ----------------------------------------------------------------------------
+
+#ifndef MAX_VOLUMES
+#define MAX_VOLUMES 4  // set by the application from the number of texture units
+#endif
+
+// Emissive volume (std140, must match "LpalVolumeBlock" in "indirect_surface.cpp")
+struct LpalVolume {
+    vec3 albedo;
+    vec3 cubeCenter;
+
+    // Irradiance probes (diffuse indirect illumination)
+    vec3 probeBoundsMin;
+    vec3 probeBoundsMax;
+
+    vec3 marginCubeVertices[8];
+    vec3 originalCubeVertices[8];
+
+    float boundingRadius;  // sphere around "cubeCenter" enclosing the margined cube (culling)
+    float voxelSize;       // world-space size of a voxel of the base level (footprint LOD)
+    int maxLOD;
+};
+
+// Per-draw shading parameters, updated with a single buffer write
+// (std140, must match "LpalShadingBlock" in "indirect_surface.cpp")
+layout(std140, binding = 0) uniform LpalShading {
+    // Camera and light
+    vec3 u_cameraPos;
+    vec3 u_lightPos;
+    vec3 u_lightLe;
+    float u_pixelAngle;  // view angle covered by a pixel (packed into the fourth component of "u_lightLe")
+
+    int u_sectionNum;
+    int u_skipBlockSize;  // number of slices tested at once for empty space skipping (<= 1: disabled)
+    bool u_useIrradianceProbes;
+    int u_numVolumes;
+
+    LpalVolume u_volumes[MAX_VOLUMES];
+};
+
+// ----------------------------------------------------------------------------
+// Culling of the volumes
+// ----------------------------------------------------------------------------
+
+float reflectionConeAngle(float alpha) {
+    // Half angle around the mirror direction which holds nearly all of the GGX lobe
+    // (the half vector of D(h) < 1% of its peak is beyond about atan(3 alpha), and atan(4 alpha)
+    // keeps a margin for rough lobes; the angle is doubled by the reflection)
+    return min(PI, 2.0 * atan(4.0 * alpha));
+}
+
+bool isVolumeInCone(int volume, vec3 pos, vec3 dir, float coneAngle) {
+    // Cone against the bounding sphere of the volume
+    vec3 toCenter = u_volumes[volume].cubeCenter - pos;
+    float dist = length(toCenter);
+    float radius = u_volumes[volume].boundingRadius;
+    if (dist <= radius) {
+        return true;
+    }
+
+    float angle = acos(clamp(dot(dir, toCenter / dist), -1.0, 1.0));
+    return angle <= coneAngle + asin(radius / dist);
+}
@@ -0,0 +1,38 @@
+// ----------------------------------------------------------------------------
+// Meshes and instances of the surfaces ("IndirectSurface::setScene")
+// ----------------------------------------------------------------------------
+
+// Range of the mesh in the shared vertex / index buffers and its position dequantization
+struct SurfaceMesh {
+    vec4 positionOffset;
+    vec4 positionScale;
+    uint firstIndex;
+    uint indexCount;
+    uint baseVertex;
+    uint vertexCount;
+};
+
+struct SurfaceInstance {
+    mat4 modelMat;
+    uint mesh;
+    uint vertexIndirectOffset;  // first entry of the instance in the vertex-rate indirect buffer
+    uint material;              // entry of the material table ("surface_materials.glsl")
+    uint padding;
+};
+
+layout(std430, binding = 2) readonly buffer SurfaceMeshBuffer {
+    SurfaceMesh meshes[];
+};
+
+layout(std430, binding = 3) readonly buffer SurfaceInstanceBuffer {
+    SurfaceInstance instances[];
+};
+
+// Layout of "glMultiDrawElementsIndirect" (one command per instance, instanceCount = 0 when culled)
+struct DrawElementsCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    uint baseVertex;
+    uint baseInstance;
+};
@@ -0,0 +1,33 @@
+// ----------------------------------------------------------------------------
+// Material table of the surfaces ("SurfaceMaterial" in surface_scene.h)
+// ----------------------------------------------------------------------------
+
+struct SurfaceMaterial {
+    vec4 eta;          // xyz: index of refraction (zero: no specular reflection)
+    vec4 kappa;        // xyz: extinction coefficient (zero: dielectric)
+    vec4 diffColor;    // xyz: diffuse reflectance
+    float roughness;   // GGX alpha, unless it is read from the roughness texture
+    bool isRoughnessTextured;
+    float vertexRateThreshold;  // GGX alpha from which the vertex-rate indirect illumination is used
+    float padding;
+};
+
+layout(std430, binding = 6) readonly buffer SurfaceMaterialBuffer {
+    SurfaceMaterial materials[];
+};
+
+uniform sampler2D u_alphaTex;
+
+float materialRoughness(SurfaceMaterial material, vec2 texcoord) {
+    if (material.isRoughnessTextured) {
+        return pow(texture(u_alphaTex, vec2(texcoord.x, 1.0 - texcoord.y)).x, 2.2);
+    }
+    return material.roughness;
+}
+
+float materialRoughnessLod(SurfaceMaterial material, vec2 texcoord, float lod) {
+    if (material.isRoughnessTextured) {
+        return pow(textureLod(u_alphaTex, vec2(texcoord.x, 1.0 - texcoord.y), lod).x, 2.2);
+    }
+    return material.roughness;
+}
@@ -0,0 +1,23 @@
+// ----------------------------------------------------------------------------
+// Quantized vertex format ("PackedVertex" in vertex_array_object.h)
+// ----------------------------------------------------------------------------
+
+// Dequantization of the unorm16 positions (bounding box of the mesh)
+vec3 decodePosition(vec3 position, vec3 offset, vec3 scale) {
+    return offset + scale * position;
+}
+
+// Octahedral encoded unit vector
+vec3 decodeNormal(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
+// Vertex read from the vertex buffer bound as "uvec4" array (x, y: position, z: texcoord, w: normal)
+void unpackVertex(uvec4 data, vec3 offset, vec3 scale, out vec3 position, out vec2 texcoord, out vec3 normal) {
+    position = decodePosition(vec3(unpackUnorm2x16(data.x), unpackUnorm2x16(data.y).x), offset, scale);
+    texcoord = unpackHalf2x16(data.z);
+    normal = decodeNormal(unpackSnorm2x16(data.w));
+}
@@ -0,0 +1,50 @@
+#version 450
+
+in vec2 f_texcoord;
+
+out vec4 out_color;
+
+uniform sampler2D u_currentTex;
+uniform sampler2D u_depthTex;    // X: window depth of the ray entry, Y: distance for reprojection
+uniform sampler2D u_historyTex;
+
+uniform mat4 u_invViewProjMat;
+uniform mat4 u_prevViewProjMat;
+uniform vec3 u_cameraPos;
+uniform float u_blendFactor;     // weight of the current frame (1: no accumulation)
+
+void main(void) {
+    const ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 current = texelFetch(u_currentTex, pixel, 0);
+    vec2 depth = texelFetch(u_depthTex, pixel, 0).xy;
+    if (depth.x >= 1.0 || u_blendFactor >= 1.0) {
+        out_color = current;
+        return;
+    }
+
+    // Reproject the representative point of the ray to the previous frame
+    vec4 farPos = u_invViewProjMat * vec4(f_texcoord * 2.0 - 1.0, 1.0, 1.0);
+    vec3 rayDir = normalize(farPos.xyz / farPos.w - u_cameraPos);
+    vec3 pos = u_cameraPos + depth.y * rayDir;
+
+    vec4 prevClip = u_prevViewProjMat * vec4(pos, 1.0);
+    vec2 prevUV = (prevClip.xy / prevClip.w) * 0.5 + 0.5;
+    if (prevClip.w <= 0.0 || any(lessThan(prevUV, vec2(0.0))) || any(greaterThan(prevUV, vec2(1.0)))) {
+        out_color = current;
+        return;
+    }
+
+    // Clamp the history to the neighborhood of the current frame to avoid ghosting
+    vec4 minColor = current;
+    vec4 maxColor = current;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            vec4 c = texelFetch(u_currentTex, pixel + ivec2(x, y), 0);
+            minColor = min(minColor, c);
+            maxColor = max(maxColor, c);
+        }
+    }
+
+    vec4 history = clamp(texture(u_historyTex, prevUV), minColor, maxColor);
+    out_color = mix(history, current, u_blendFactor);
+}
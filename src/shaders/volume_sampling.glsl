@@ -0,0 +1,66 @@
+// ----------------------------------------------------------------------------
+// Lookups of the filtered volume (included by "lpal_common.glsl" and "bakeIrradiance.comp")
+//
+// With the mip chain, the footprint of a lookup is given by the mip level.
+// With the summed-area table (SAT), the same level is turned into an axis-aligned
+// box whose average is computed from the eight corners of the box (one texel fetch
+// each, as the box is snapped to texel boundaries). The box width is 2^LOD texels
+// scaled by u_satFootprintScale, which matches the variance of the Gaussian filter
+// applied to each mip level.
+//
+// The summed-area table of the volume ("satTex": inclusive prefix sums, RGB: rad,
+// A: density) is declared by the including shader. It is built from the volume minus
+// its mean, so that the sums stay small and the eight-term difference of a small box
+// keeps its precision. The mean is stored at the top level of the filtered texture.
+// ----------------------------------------------------------------------------
+
+uniform bool u_useSummedAreaTable = false;
+uniform float u_satFootprintScale = 1.0;
+
+vec4 satFetch(sampler3D satTex, ivec3 i, ivec3 texSize) {
+    // Inclusive sum up to texel i (zero before the first texel, the total beyond the last)
+    if (any(lessThan(i, ivec3(0)))) {
+        return vec4(0.0);
+    }
+    return texelFetch(satTex, min(i, texSize - 1), 0);
+}
+
+vec4 sampleVolumeBox(sampler3D tex, sampler3D satTex, vec3 uvw, float LOD) {
+    // The box is snapped to texel boundaries, so its sum is the exact eight-term difference
+    // of single fetches (the shift of half a texel at most is small against the box width,
+    // which is several texels even at level 0)
+    const ivec3 texSize = textureSize(satTex, 0);
+    const float width = u_satFootprintScale * exp2(LOD);
+    const ivec3 lo = ivec3(round(uvw * vec3(texSize) - 0.5 * width));
+    const ivec3 hi = max(ivec3(round(uvw * vec3(texSize) + 0.5 * width)), lo + 1);
+
+    // Inclusive corners of the part of the box inside the volume
+    const ivec3 c0 = clamp(lo, ivec3(0), texSize) - 1;
+    const ivec3 c1 = clamp(hi, ivec3(0), texSize) - 1;
+    vec4 sum = satFetch(satTex, c1, texSize)
+             - satFetch(satTex, ivec3(c0.x, c1.y, c1.z), texSize)
+             - satFetch(satTex, ivec3(c1.x, c0.y, c1.z), texSize)
+             - satFetch(satTex, ivec3(c1.x, c1.y, c0.z), texSize)
+             + satFetch(satTex, ivec3(c0.x, c0.y, c1.z), texSize)
+             + satFetch(satTex, ivec3(c0.x, c1.y, c0.z), texSize)
+             + satFetch(satTex, ivec3(c1.x, c0.y, c0.z), texSize)
+             - satFetch(satTex, c0, texSize);
+
+    // The mean is added back for the part of the box inside the volume (voxels outside
+    // count as zero, same as the border of the mip chain)
+    const ivec3 inside = c1 - c0;
+    const vec4 mean = texelFetch(tex, ivec3(0), textureQueryLevels(tex) - 1);
+    sum += mean * float(inside.x * inside.y * inside.z);
+
+    // Only rounding errors remain below zero
+    const ivec3 boxSize = hi - lo;
+    return max(sum / float(boxSize.x * boxSize.y * boxSize.z), vec4(0.0));
+}
+
+vec4 sampleVolume(sampler3D tex, sampler3D satTex, vec3 uvw, float LOD) {
+    if (u_useSummedAreaTable) {
+        // The box of level 0 has the variance of the Gaussian filter of level 0
+        return sampleVolumeBox(tex, satTex, uvw, max(LOD, 0.0));
+    }
+    return textureLod(tex, uvw, LOD);
+}
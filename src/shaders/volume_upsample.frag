@@ -0,0 +1,58 @@
+#version 450
+
+in vec2 f_texcoord;
+
+out vec4 out_color;
+
+uniform sampler2D u_colorTex;       // volume radiance + opacity (low resolution)
+uniform sampler2D u_depthTex;       // X: window depth of the ray entry, Z: scene depth (low resolution)
+uniform sampler2D u_sceneDepthTex;  // scene depth (full resolution)
+uniform bool u_useSceneDepth = false;
+uniform vec2 u_projParams;          // (P[2][2], P[3][2]) of the projection matrix
+uniform float u_depthThreshold = 0.05;
+
+float linearDepth(float depth) {
+    return u_projParams.y / ((2.0 * depth - 1.0) + u_projParams.x);
+}
+
+void main(void) {
+    const ivec2 lowSize = textureSize(u_colorTex, 0);
+    const vec2 lowPos = f_texcoord * vec2(lowSize) - 0.5;
+    const ivec2 base = ivec2(floor(lowPos));
+
+    float sceneDepth = 1.0;
+    if (u_useSceneDepth) {
+        sceneDepth = texelFetch(u_sceneDepthTex, ivec2(gl_FragCoord.xy), 0).x;
+    }
+    const float sceneDist = linearDepth(sceneDepth);
+
+    // Nearest-depth upsampling: among the four low resolution texels around the pixel,
+    // take the one which saw the same surface when the depths are discontinuous
+    ivec2 nearest = clamp(base, ivec2(0), lowSize - 1);
+    float nearestDiff = 1.0e20;
+    float maxDiff = 0.0;
+    float entryDepth = 1.0;
+    for (int i = 0; i < 4; i++) {
+        const ivec2 coords = clamp(base + ivec2(i & 1, i >> 1), ivec2(0), lowSize - 1);
+        const vec4 depth = texelFetch(u_depthTex, coords, 0);
+        const float diff = abs(linearDepth(depth.z) - sceneDist) / sceneDist;
+        if (diff < nearestDiff) {
+            nearestDiff = diff;
+            nearest = coords;
+        }
+        maxDiff = max(maxDiff, diff);
+        entryDepth = min(entryDepth, depth.x);
+    }
+
+    if (maxDiff < u_depthThreshold) {
+        out_color = texture(u_colorTex, f_texcoord);
+    } else {
+        out_color = texelFetch(u_colorTex, nearest, 0);
+        entryDepth = texelFetch(u_depthTex, nearest, 0).x;
+    }
+
+    if (entryDepth >= 1.0) {
+        discard;
+    }
+    gl_FragDepth = entryDepth;
+}